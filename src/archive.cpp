@@ -16,12 +16,16 @@
 */
 
 #include "archive.h"
+#include "hash.h"
 #include "endian.h"
 #include "filesystem.h"
+#include "profile.h"
 #include <cstdint>
 #include <cctype>
 #include <cstring>
 #include <cassert>
+#include <algorithm>
+#include <map>
 #include <intrin.h>
 
 static const uint8_t KEY[] = {0x9B, 0x16, 0xFE, 0x3A, 0xB9, 0xE0, 0xA3, 0x17, 0x9A, 0x23, 0x20, 0xAE};
@@ -210,6 +214,36 @@ void Archive::open(const std::wstring& filename)
     }
 }
 
+void Archive::open(const void *data, std::size_t size)
+{
+    close();
+
+    data_.reset(new char[size]);
+    memcpy(data_.get(), data, size);
+    data_used_ = size;
+    data_max_ = size;
+
+    try
+    {
+        parse();
+    }
+    catch(const ArcError&)
+    {
+        close();
+        throw;
+    }
+}
+
+std::future<Archive> Archive::open_async(const std::wstring& filename)
+{
+    return std::async(std::launch::async, [filename]()
+    {
+        Archive arc;
+        arc.open(filename);
+        return arc;
+    });
+}
+
 bool Archive::save(const std::string& filename)
 {
     if(!data_)
@@ -438,6 +472,9 @@ bool Archive::repack_file(int index, const void * src, size_t len)
 
     data_used_ = new_used;
 
+    PROFILE_ADD(PROFILE_REPACK_FILES, 1);
+    PROFILE_ADD(PROFILE_REPACK_BYTES, data_used_ - (file_header.data_offset + header_.data_offset)); /* the new file plus everything after it */
+
     header_.filename_table_offset += diff;
     write_le32(&data_[12], header_.filename_table_offset);
 
@@ -452,9 +489,218 @@ bool Archive::repack_file(int index, const void * src, size_t len)
             *off += (uint32_t)diff;
     }
 
+    if(journal_ != nullptr)
+    {
+        auto copy = new char[len];
+        memcpy(copy, src, len);
+        journal_->push_back(ArcFile(copy, len, index));
+    }
+
+    return true;
+}
+
+bool Archive::repack_files(const std::vector<ArcFile>& files)
+{
+    struct Replacement
+    {
+        std::size_t offset;         /* relative to data_offset in the archive header */
+        std::size_t orig_len;
+        std::size_t header_offset;  /* relative to the file table */
+        const ArcFile *file;
+    };
+
+    std::map<int, const ArcFile*> latest;
+    for(const auto& file : files)
+        latest[file.file_index()] = &file;
+
+    std::size_t file_table_offset = header_.filename_table_offset + header_.file_table_offset;
+    std::size_t dir_table_offset = header_.filename_table_offset + header_.dir_table_offset;
+
+    std::vector<Replacement> replacements;
+    std::size_t new_used = data_used_;
+    for(const auto& it : latest)
+    {
+        if(it.first < 0)
+            return false;
+
+        std::size_t header_offset = it.first * ARCHIVE_FILE_HEADER_SIZE;
+        if(file_table_offset + header_offset >= dir_table_offset)
+            return false;
+
+        ArchiveFileHeader file_header(&data_[file_table_offset + header_offset]);
+        std::size_t orig_len = (file_header.compressed_size == ARCHIVE_NO_COMPRESSION) ? file_header.data_size : file_header.compressed_size;
+        replacements.push_back({file_header.data_offset, orig_len, header_offset, it.second});
+        new_used += it.second->size() - orig_len;
+    }
+
+    if(replacements.empty())
+        return true;
+
+    std::stable_sort(replacements.begin(), replacements.end(), [](const Replacement& a, const Replacement& b) { return a.offset < b.offset; });
+
+    /* copy the archive into the new buffer, swapping in the replacements as we pass them */
+    std::unique_ptr<char[]> buf(new char[new_used]);
+    std::size_t src = 0, dest = 0;
+    for(const auto& r : replacements)
+    {
+        std::size_t start = header_.data_offset + r.offset;
+        if(start < src)
+            return false;   /* overlapping files */
+
+        memcpy(&buf[dest], &data_[src], start - src);
+        dest += start - src;
+        memcpy(&buf[dest], r.file->data(), r.file->size());
+        dest += r.file->size();
+        src = start + r.orig_len;
+    }
+    memcpy(&buf[dest], &data_[src], data_used_ - src);
+
+    header_.filename_table_offset += new_used - data_used_;
+    write_le32(&buf[12], header_.filename_table_offset);
+
+    file_table_offset = header_.filename_table_offset + header_.file_table_offset;
+    dir_table_offset = header_.filename_table_offset + header_.dir_table_offset;
+
+    /* every file is moved by the size differences of the replacements before it */
+    std::vector<std::size_t> shifts(1, 0);
+    for(const auto& r : replacements)
+        shifts.push_back(shifts.back() + r.file->size() - r.orig_len);
+
+    for(std::size_t i = file_table_offset; i < dir_table_offset; i += ARCHIVE_FILE_HEADER_SIZE)
+    {
+        uint32_t off = read_le32(&buf[i + 32]);
+        auto pos = std::lower_bound(replacements.begin(), replacements.end(), off, [](const Replacement& r, uint32_t val) { return r.offset < val; });
+        write_le32(&buf[i + 32], (uint32_t)(off + shifts[pos - replacements.begin()]));
+    }
+
+    for(const auto& r : replacements)
+    {
+        write_le32(&buf[file_table_offset + r.header_offset + 36], (uint32_t)r.file->size());
+        write_le32(&buf[file_table_offset + r.header_offset + 40], ARCHIVE_NO_COMPRESSION);
+
+        if(journal_ != nullptr)
+        {
+            auto copy = new char[r.file->size()];
+            memcpy(copy, r.file->data(), r.file->size());
+            journal_->push_back(ArcFile(copy, r.file->size(), r.file->file_index()));
+        }
+    }
+
+    data_.reset(buf.release());
+    data_used_ = new_used;
+    data_max_ = new_used;
+
+    PROFILE_ADD(PROFILE_REPACK_FILES, replacements.size());
+    PROFILE_ADD(PROFILE_REPACK_BYTES, new_used);
+
     return true;
 }
 
+/* greedy LZ77 with hash chains, in the format read by decompress().
+ * the least common byte of the input is used as the escape key */
+std::vector<char> Archive::compress(const void *src, std::size_t len)
+{
+    const std::size_t hash_bits = 16;
+    const std::size_t max_chain = 32;
+    const std::size_t max_match = 8191 + 4;
+    const std::size_t max_offset = 0x1000000;
+    const uint8_t *in = (const uint8_t*)src;
+
+    std::size_t freq[256] = {};
+    for(std::size_t i = 0; i < len; ++i)
+        ++freq[in[i]];
+
+    uint8_t key = (uint8_t)(std::min_element(std::begin(freq), std::end(freq)) - std::begin(freq));
+
+    std::vector<char> out(9);
+    out.reserve(len + (len / 8) + 9);
+
+    std::vector<int32_t> head(std::size_t(1) << hash_bits, -1);
+    std::vector<int32_t> prev(len);
+    auto hash = [&](std::size_t pos) { return (std::size_t)((read_le32(&in[pos]) * 2654435761u) >> (32 - hash_bits)); };
+    auto insert = [&](std::size_t pos)
+    {
+        if(pos + 4 > len)
+            return;
+        std::size_t h = hash(pos);
+        prev[pos] = head[h];
+        head[h] = (int32_t)pos;
+    };
+
+    std::size_t pos = 0;
+    while(pos < len)
+    {
+        std::size_t best_len = 0, best_offset = 0;
+
+        if(pos + 4 <= len)
+        {
+            std::size_t limit = std::min(len - pos, max_match);
+            int32_t candidate = head[hash(pos)];
+            for(std::size_t chain = 0; (candidate >= 0) && (chain < max_chain); ++chain, candidate = prev[candidate])
+            {
+                std::size_t offset = pos - candidate;
+                if(offset > max_offset)
+                    break;
+
+                std::size_t match = 0;
+                while((match < limit) && (in[candidate + match] == in[pos + match]))
+                    ++match;
+
+                if(match > best_len)
+                {
+                    best_len = match;
+                    best_offset = offset;
+                    if(match == limit)
+                        break;
+                }
+            }
+        }
+
+        if(best_len >= 4)
+        {
+            std::size_t encoded_len = best_len - 4;
+            std::size_t encoded_offset = best_offset - 1;
+            unsigned int offset_len = (encoded_offset <= 0xFF) ? 0 : ((encoded_offset <= 0xFFFF) ? 1 : 2);
+            std::size_t cost = 3 + (encoded_len > 31) + offset_len;
+
+            if(cost < best_len)
+            {
+                unsigned int val = (unsigned int)((encoded_len & 31) << 3) | offset_len | ((encoded_len > 31) ? 4 : 0);
+
+                out.push_back((char)key);
+                out.push_back((char)((val >= key) ? val + 1 : val));    /* the key itself is reserved for escapes */
+                if(encoded_len > 31)
+                    out.push_back((char)(encoded_len >> 5));
+                for(unsigned int i = 0; i <= offset_len; ++i)
+                    out.push_back((char)(encoded_offset >> (i * 8)));
+
+                for(std::size_t i = 0; i < best_len; ++i)
+                    insert(pos + i);
+                pos += best_len;
+                continue;
+            }
+        }
+
+        out.push_back((char)in[pos]);
+        if(in[pos] == key)
+            out.push_back((char)key);
+
+        insert(pos);
+        ++pos;
+    }
+
+    write_le32(&out[0], (uint32_t)len);
+    write_le32(&out[4], (uint32_t)out.size());
+    out[8] = (char)key;
+
+    return out;
+}
+
+uint64_t Archive::content_hash() const
+{
+    return Hasher().add(data_.get(), data_used_).value();
+}
+
 bool Archive::repack_file(const ArcFile& file)
 {
     if(!file)
@@ -547,7 +793,7 @@ bool Archive::is_dir(int index) const
     return (get_dir_header_offset(index * ARCHIVE_FILE_HEADER_SIZE) != -1);
 }
 
-std::size_t Archive::decompress(const void *src, void *dest) const
+std::size_t Archive::decompress(const void *src, void *dest)
 {
     uint32_t output_size, input_size, offset, bytes_written = 0, len;
     uint8_t *outptr, key;
@@ -645,3 +891,170 @@ std::size_t Archive::decompress(const void *src, void *dest) const
 
     return bytes_written;
 }
+
+std::size_t Archive::decompress(const void *src, std::size_t src_len, void *dest, std::size_t dest_len)
+{
+    const uint8_t *inptr = (const uint8_t*)src;
+    uint8_t *outptr = (uint8_t*)dest;
+
+    if((src_len < 9) || (read_le32(&inptr[0]) != dest_len) || (read_le32(&inptr[4]) != src_len))
+        return 0;
+
+    const uint8_t *endin = inptr + src_len;
+    std::size_t bytes_written = 0;
+    uint8_t key = inptr[8];
+    inptr += 9;
+
+    while(inptr < endin)
+    {
+        if(inptr[0] != key)
+        {
+            if(bytes_written >= dest_len)
+                return 0;
+            outptr[bytes_written++] = *(inptr++);
+            continue;
+        }
+
+        if((endin - inptr) < 2)
+            return 0;
+
+        if(inptr[1] == key)	/* escape sequence */
+        {
+            if(bytes_written >= dest_len)
+                return 0;
+            outptr[bytes_written++] = key;
+            inptr += 2;
+            continue;
+        }
+
+        unsigned int val = inptr[1];
+        if(val > key)
+            --val;
+
+        inptr += 2;
+
+        unsigned int offset_len = val & 3;
+        std::size_t len = val >> 3;
+
+        /* the extra length byte plus 1 to 3 offset bytes */
+        std::size_t needed = ((val & 4) ? 1 : 0) + ((offset_len < 2) ? (offset_len + 1) : 3);
+        if((std::size_t)(endin - inptr) < needed)
+            return 0;
+
+        if(val & 4)
+            len |= (std::size_t)*inptr++ << 5;
+
+        len += 4;
+
+        std::size_t offset = inptr[0];
+        if(offset_len > 0)
+            offset |= (std::size_t)inptr[1] << 8;
+        if(offset_len > 1)
+            offset |= (std::size_t)inptr[2] << 16;
+        inptr += (offset_len < 2) ? (offset_len + 1) : 3;
+        ++offset;
+
+        if((offset > bytes_written) || (len > (dest_len - bytes_written)))
+            return 0;
+
+        /* the source may overlap the bytes being written, so copy one byte at a time */
+        for(uint8_t *out = &outptr[bytes_written], *end = out + len; out != end; ++out)
+            *out = *(out - offset);
+        bytes_written += len;
+    }
+
+    return (bytes_written == dest_len) ? bytes_written : 0;
+}
+
+void ArchiveWriter::write(Archive&& arc, const std::wstring& path)
+{
+    PendingWrite pending;
+    pending.archive.reset(new Archive(std::move(arc)));
+    pending.path = path;
+    pending.temp_path = path + L".tmp";
+
+    Archive *archive = pending.archive.get();
+    std::wstring temp_path = pending.temp_path;
+    pending.result = std::async(std::launch::async, [archive, temp_path]()
+    {
+        return archive->save(temp_path);
+    });
+
+    pending_.push_back(std::move(pending));
+}
+
+bool ArchiveWriter::commit(std::wstring& failed_path)
+{
+    for(auto& i : pending_)
+    {
+        if(!i.result.get())
+        {
+            failed_path = i.path;
+            discard();
+            return false;
+        }
+    }
+
+    /* move all of the originals out of the way before replacing any of them,
+     * so a failure part way through can still be undone */
+    for(auto& i : pending_)
+    {
+        i.backup_path = i.path + L".bak";
+        if(path_exists(i.path))
+        {
+            if(!rename_file(i.path, i.backup_path))
+            {
+                failed_path = i.path;
+                rollback();
+                return false;
+            }
+            i.backed_up = true;
+        }
+    }
+
+    for(auto& i : pending_)
+    {
+        if(!rename_file(i.temp_path, i.path))
+        {
+            failed_path = i.path;
+            rollback();
+            return false;
+        }
+        i.replaced = true;
+    }
+
+    for(auto& i : pending_)
+    {
+        if(i.backed_up)
+            remove_file(i.backup_path);
+    }
+
+    pending_.clear();
+    return true;
+}
+
+/* puts back every original moved by commit() and deletes the temporary files */
+void ArchiveWriter::rollback()
+{
+    for(auto& i : pending_)
+    {
+        if(i.backed_up)
+            rename_file(i.backup_path, i.path);
+        else if(i.replaced)
+            remove_file(i.path);
+    }
+
+    discard();
+}
+
+void ArchiveWriter::discard()
+{
+    for(auto& i : pending_)
+    {
+        if(i.result.valid())
+            i.result.wait();
+        remove_file(i.temp_path);
+    }
+
+    pending_.clear();
+}
@@ -21,6 +21,8 @@
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <future>
+#include <vector>
 
 #define ARCHIVE_MAGIC 0x5844
 #define ARCHIVE_HEADER_SIZE 28
@@ -132,6 +134,7 @@ private:
     std::size_t data_used_, data_max_;
     std::unique_ptr<char[]> data_;
     bool is_ynk_;
+    std::vector<ArcFile> *journal_;
 
     Archive(const Archive&) = delete;
     Archive& operator=(const Archive&) = delete;
@@ -143,10 +146,8 @@ private:
     void encrypt();
     void decrypt() { encrypt(); } // encryption is symmetical, this is an alias of encrypt()
 
-    std::size_t decompress(const void *src, void *dest) const;
-
 public:
-    Archive() : header_(), data_used_(0), data_max_(0), is_ynk_(false) {};
+    Archive() : header_(), data_used_(0), data_max_(0), is_ynk_(false), journal_(nullptr) {};
     ~Archive() { close(); }
 
     /* allow move semantics */
@@ -158,6 +159,11 @@ public:
     /* throws ArcError on failure */
     void open(const std::string& filename);
     void open(const std::wstring& filename);
+    void open(const void *data, std::size_t size); /* open a copy of an archive file that's already in memory */
+
+    /* read and decrypt an archive on a background thread.
+     * the returned future rethrows ArcError on failure */
+    static std::future<Archive> open_async(const std::wstring& filename);
 
     bool save(const std::string& filename);
     bool save(const std::wstring& filename);
@@ -175,6 +181,20 @@ public:
     bool repack_file(int index, const void *src, size_t len);
     bool repack_file(const ArcFile& file);
 
+    /* replace many files in a single pass over the archive, which is much faster than
+     * calling repack_file() for each of them. if the same file appears more than once
+     * the last one wins */
+    bool repack_files(const std::vector<ArcFile>& files);
+
+    /* compress/decompress data with the archive's LZ scheme.
+     * decompress returns 0 on error, nonzero otherwise. if dest is NULL, returns decompressed size */
+    static std::vector<char> compress(const void *src, std::size_t len);
+    static std::size_t decompress(const void *src, void *dest);
+
+    /* for data that doesn't come from the game files. never reads past src_len or writes past dest_len,
+     * returns 0 unless the whole input decodes to exactly dest_len bytes */
+    static std::size_t decompress(const void *src, std::size_t src_len, void *dest, std::size_t dest_len);
+
     std::string get_filename(int index) const;
     std::string get_path(int index) const;
 
@@ -187,7 +207,56 @@ public:
 
     bool is_ynk() const {return is_ynk_;}
 
+    /* hash of the (decrypted) archive contents */
+    uint64_t content_hash() const;
+
+    /* if set, a copy of every file passed to repack_file() is appended to the journal,
+     * so the same changes can be replayed on another copy of the archive later.
+     * pass NULL to stop recording */
+    void set_journal(std::vector<ArcFile> *journal) { journal_ = journal; }
+
     void close() { data_.reset(); data_used_ = 0; data_max_ = 0; is_ynk_ = false; }
 };
 
+/* writes finished archives to temporary files on a background thread.
+ * the temporary files only replace the real files when commit() is called,
+ * if the writer is destroyed before that they are discarded. */
+class ArchiveWriter
+{
+private:
+    struct PendingWrite
+    {
+        std::unique_ptr<Archive> archive;
+        std::wstring path;
+        std::wstring temp_path;
+        std::wstring backup_path;   /* the original archive while commit() moves files around */
+        std::future<bool> result;
+        bool backed_up = false;     /* original was moved to backup_path */
+        bool replaced = false;      /* temp_path was moved to path */
+    };
+
+    void rollback();
+
+    std::vector<PendingWrite> pending_;
+
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+public:
+    ArchiveWriter() = default;
+    ~ArchiveWriter() { discard(); }
+
+    /* takes ownership of the archive and starts writing it */
+    void write(Archive&& arc, const std::wstring& path);
+
+    /* waits for all writes to finish and moves the files into place.
+     * either every archive is replaced or none are: the originals are moved to backups first
+     * and put back if any step fails.
+     * returns false on failure and sets failed_path to the file that couldn't be written */
+    bool commit(std::wstring& failed_path);
+
+    /* waits for all writes to finish and deletes the temporary files */
+    void discard();
+};
+
 #endif // ARCHIVE_H
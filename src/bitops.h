@@ -0,0 +1,63 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BITOPS_H
+#define BITOPS_H
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* portable bit twiddling helpers.
+ * the 64 bit intrinsics aren't available on 32 bit MSVC builds, so those
+ * fall back to operating on each half of the word. */
+
+/* index of the lowest set bit. x must not be zero */
+inline unsigned int count_trailing_zeros(uint64_t x)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if(_BitScanForward(&index, (unsigned long)x))
+        return index;
+    _BitScanForward(&index, (unsigned long)(x >> 32));
+    return index + 32;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+/* number of set bits.
+ * the popcnt instruction isn't guaranteed to be present on older CPUs,
+ * so MSVC gets the plain bit twiddling version */
+inline unsigned int popcount(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (unsigned int)((x * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+#endif // BITOPS_H
@@ -17,9 +17,13 @@
 
 #ifndef CONTAINERS_H
 #define CONTAINERS_H
+#include "bitops.h"
+#include "random.h"
 #include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
 #include <vector>
-#include <random>
 #include <cassert>
 #include <type_traits>
 #include <optional>
@@ -30,48 +34,49 @@ struct ContainerError : public std::runtime_error
 };
 
 /* A randomized "pool" that will refresh itself when depleted.
- * Values are copied from a provided source container. */
+ * Values are copied from a provided source container.
+ * Nothing is shuffled up front, each draw picks a random value from the ones
+ * remaining and swaps it to the end of the live region (an incremental Fisher-Yates
+ * shuffle). Drawn values stay in the buffer, so refilling the pool is free. */
 template<typename T>
 class RandPool
 {
 private:
     std::vector<T> pool_;
-    std::vector<T> src_;
+    std::size_t remaining_ = 0; /* values in [0, remaining_) haven't been drawn yet */
 
 public:
     RandPool() = default;
 
-    template<typename Src, typename Rng>
-    RandPool(const Src& src, Rng& gen) : src_(src.begin(), src.end())
+    template<typename Src>
+    explicit RandPool(const Src& src) : pool_(src.begin(), src.end()), remaining_(pool_.size())
     {
         assert(src.size());
-        reset(gen);
     }
 
-    template<typename Src, typename Rng>
-    void assign(const Src& src, Rng& gen)
+    template<typename Src>
+    void assign(const Src& src)
     {
         assert(src.size());
-        src_.assign(src.begin(), src.end());
-        reset(gen);
+        pool_.assign(src.begin(), src.end());
+        remaining_ = pool_.size();
     }
 
-    template<typename Rng>
-    void reset(Rng& gen)
+    /* put every value back into the pool */
+    void reset()
     {
-        assert(src_.size());
-        pool_ = src_;
-        std::shuffle(pool_.begin(), pool_.end(), gen);
+        remaining_ = pool_.size();
     }
 
     void clear()
     {
         pool_.clear();
-        src_.clear();
+        remaining_ = 0;
     }
 
     using iterator = typename std::vector<T>::iterator;
 
+    /* iterates over the values that haven't been drawn yet, in no particular order */
     auto begin()
     {
         return pool_.begin();
@@ -79,66 +84,78 @@ public:
 
     auto end()
     {
-        return pool_.end();
+        return pool_.begin() + remaining_;
     }
 
+    /* removes the value from the pool until it is next refilled.
+     * returns an iterator to the value that took its place */
     auto erase(iterator it)
     {
-        return pool_.erase(it);
+        std::swap(*it, pool_[--remaining_]);
+        return it;
     }
 
     bool empty()
     {
-        return pool_.empty();
+        return remaining_ == 0;
     }
 
     /* Draw a value from the pool. the returned value is removed from the pool.
-     * If there are no more values in the pool, the pool is refilled with all the original
-     * values and shuffled again.
-     * Throws ContainerError if pool and source container are both empty. */
+     * If there are no more values in the pool, the pool is refilled with all the original values.
+     * Throws ContainerError if the source container was empty. */
     template<typename Rng>
     T draw(Rng& gen)
     {
-        assert(src_.size());
-        if(pool_.empty() && src_.empty())
+        assert(pool_.size());
+        if(pool_.empty())
             throw ContainerError("Tried to draw from an empty pool");
 
-        if(pool_.empty())
-            reset(gen);
+        if(!remaining_)
+            reset();
 
-        T ret = pool_.back();
-        pool_.pop_back();
+        std::size_t index = (std::size_t)random_below(gen, remaining_);
+        std::swap(pool_[index], pool_[--remaining_]);
 
-        return ret;
+        return pool_[remaining_];
     }
 };
 
 /* Create a randomized "deck" from a source container.
- * This deck does not refresh itself when empty. */
+ * This deck does not refresh itself when empty.
+ * Like RandPool, cards are picked at random as they are drawn rather than
+ * shuffling the whole deck up front, so the cost depends only on the number of draws. */
 template<typename T>
 class RandDeck
 {
 private:
     std::vector<T> deck_;
 
+    template<typename Rng>
+    T take(Rng& gen)
+    {
+        std::size_t index = (std::size_t)random_below(gen, deck_.size());
+        std::swap(deck_[index], deck_.back());
+
+        T ret = deck_.back();
+        deck_.pop_back();
+        return ret;
+    }
+
 public:
     RandDeck() = default;
 
-    template<typename Src, typename Rng>
-    RandDeck(const Src& src, Rng& gen) : deck_(src.begin(), src.end())
-    {
-        std::shuffle(deck_.begin(), deck_.end(), gen);
-    }
+    template<typename Src>
+    explicit RandDeck(const Src& src) : deck_(src.begin(), src.end()) {}
 
-    template<typename Src, typename Rng>
-    void assign(const Src& src, Rng& gen)
+    template<typename Src>
+    void assign(const Src& src)
     {
         deck_.assign(src.begin(), src.end());
-        std::shuffle(deck_.begin(), deck_.end(), gen);
     }
 
     using iterator = typename std::vector<T>::iterator;
 
+    /* iterates over the cards left in the deck, in no particular order */
     auto begin()
     {
         return deck_.begin();
@@ -149,9 +166,14 @@ public:
         return deck_.end();
     }
 
+    /* removes the card by swapping the last card into its place.
+     * returns an iterator to the card that took its place */
     auto erase(iterator it)
     {
-        return deck_.erase(it);
+        auto index = it - deck_.begin();
+        *it = deck_.back();
+        deck_.pop_back();
+        return deck_.begin() + index;
     }
 
     bool empty()
@@ -164,44 +186,503 @@ public:
         deck_.clear();
     }
 
-    /* Draw a value from the deck. The returned value is removed from the deck.
+    /* Draw a random card from the deck. The returned value is removed from the deck.
      * Returns empty optional if the deck is empty */
-    std::optional<T> draw()
+    template<typename Rng>
+    std::optional<T> draw(Rng& gen)
     {
         if(deck_.empty())
             return {};
 
-        T ret;
-        ret = deck_.back();
-        deck_.pop_back();
-        return ret;
+        return take(gen);
     }
 
-    /* Draw a value from the deck. The returned value is removed from the deck.
+    /* Draw a random card from the deck. The returned value is removed from the deck.
      * Returns default_value if the deck is empty */
-    T draw(T default_value)
+    template<typename Rng>
+    T draw(Rng& gen, T default_value)
     {
         if(deck_.empty())
             return default_value;
 
-        T ret;
-        ret = deck_.back();
-        deck_.pop_back();
-        return ret;
+        return take(gen);
     }
 
-    /* Draw a value from the deck. The returned value is removed from the deck.
+    /* Draw a random card from the deck. The returned value is removed from the deck.
      * Throws ContainerError if the deck is empty */
-    T draw_throw()
+    template<typename Rng>
+    T draw_throw(Rng& gen)
     {
         if(deck_.empty())
             throw ContainerError("Tried to draw from an empty deck");
 
-        T ret;
-        ret = deck_.back();
-        deck_.pop_back();
+        return take(gen);
+    }
+};
+
+/* A shuffled deck that also indexes its contents by a small integer key
+ * (e.g. the element of a skill), so values matching a key can be drawn without
+ * scanning the whole deck.
+ * Removed values are only marked dead and skipped over later, nothing is erased
+ * from the middle of the vector.
+ * draw() takes from the back of the deck, while draw_key() and draw_first() take
+ * the matching value closest to the front, which is exactly what a front-to-back
+ * search of the shuffled vector would find. */
+template<typename T>
+class BucketDeck
+{
+private:
+    std::vector<T> deck_;
+    std::vector<uint8_t> dead_;
+    std::size_t back_ = 0;                      /* everything at or past this index is dead */
+    std::size_t live_ = 0;
+    std::vector<std::vector<std::size_t>> buckets_; /* deck indices for each key, in ascending order */
+    std::vector<std::size_t> heads_;            /* first possibly live entry in each bucket */
+
+    void kill(std::size_t index)
+    {
+        dead_[index] = 1;
+        --live_;
+    }
+
+    /* deck index of the first live value with the given key, or deck_.size() if there is none */
+    std::size_t find_key(unsigned int key)
+    {
+        if(key >= buckets_.size())
+            return deck_.size();
+
+        auto& bucket = buckets_[key];
+        auto& head = heads_[key];
+        while((head < bucket.size()) && dead_[bucket[head]])
+            ++head;
+
+        return (head < bucket.size()) ? bucket[head] : deck_.size();
+    }
+
+public:
+    BucketDeck() = default;
+
+    /* key(value) must return a small unsigned integer, a vector of buckets is
+     * allocated up to the largest key */
+    template<typename Src, typename Rng, typename Key>
+    void assign(const Src& src, Rng& gen, Key&& key)
+    {
+        deck_.assign(src.begin(), src.end());
+        rand_shuffle(deck_.begin(), deck_.end(), gen);
+        dead_.assign(deck_.size(), 0);
+        back_ = deck_.size();
+        live_ = deck_.size();
+
+        /* keep the old buckets around so we don't reallocate them on every assign() */
+        for(auto& i : buckets_)
+            i.clear();
+
+        for(std::size_t i = 0; i < deck_.size(); ++i)
+        {
+            std::size_t k = key(deck_[i]);
+            if(k >= buckets_.size())
+                buckets_.resize(k + 1);
+            buckets_[k].push_back(i);
+        }
+
+        heads_.assign(buckets_.size(), 0);
+    }
+
+    bool empty() const { return live_ == 0; }
+    std::size_t size() const { return live_; }
+
+    void clear()
+    {
+        deck_.clear();
+        dead_.clear();
+        back_ = 0;
+        live_ = 0;
+        for(auto& i : buckets_)
+            i.clear();
+        heads_.assign(buckets_.size(), 0);
+    }
+
+    /* Draw a value from the back of the deck. The returned value is removed from the deck.
+     * Returns empty optional if the deck is empty */
+    std::optional<T> draw()
+    {
+        while(back_ && dead_[back_ - 1])
+            --back_;
+
+        if(!back_)
+            return {};
+
+        kill(--back_);
+        return deck_[back_];
+    }
+
+    /* Draw a value from the back of the deck. The returned value is removed from the deck.
+     * Returns default_value if the deck is empty */
+    T draw(T default_value)
+    {
+        auto ret = draw();
+        return ret ? *ret : default_value;
+    }
+
+    /* Draw the value nearest the front of the deck whose key is key1 or key2.
+     * Returns empty optional if there is no such value */
+    std::optional<T> draw_key(unsigned int key1, unsigned int key2)
+    {
+        std::size_t index = find_key(key1);
+        if(key2 != key1)
+            index = std::min(index, find_key(key2));
+
+        if(index >= deck_.size())
+            return {};
+
+        kill(index);
+        return deck_[index];
+    }
+
+    /* Draw the value nearest the front of the deck for which pred(value) is true.
+     * this is a linear search, use draw_key() where possible.
+     * Returns empty optional if there is no such value */
+    template<typename Pred>
+    std::optional<T> draw_first(Pred&& pred)
+    {
+        for(std::size_t i = 0; i < back_; ++i)
+        {
+            if(!dead_[i] && pred(deck_[i]))
+            {
+                kill(i);
+                return deck_[i];
+            }
+        }
+
+        return {};
+    }
+};
+
+/* Table of values indexed directly by a (reasonably small) ID.
+ * Values are stored contiguously, with a bitmap recording which IDs are present.
+ * Iteration visits present values in ascending order of ID, like a std::map would.
+ * Lookups never insert anything, missing IDs have to be added with insert(). */
+template<typename T>
+class IDTable
+{
+private:
+    std::vector<T> data_;
+    std::vector<uint64_t> present_;
+    std::size_t size_ = 0;
+
+    void mark(std::size_t id)
+    {
+        uint64_t bit = uint64_t(1) << (id % 64);
+        if(!(present_[id / 64] & bit))
+        {
+            present_[id / 64] |= bit;
+            ++size_;
+        }
+    }
+
+    /* first present ID >= id, or capacity() if there is none */
+    std::size_t next_present(std::size_t id) const
+    {
+        std::size_t word = id / 64;
+        if(word >= present_.size())
+            return capacity();
+
+        uint64_t bits = present_[word] & (~uint64_t(0) << (id % 64));
+        while(!bits)
+        {
+            if(++word >= present_.size())
+                return capacity();
+            bits = present_[word];
+        }
+
+        return (word * 64) + count_trailing_zeros(bits);
+    }
+
+    template<typename Table, typename Value>
+    class basic_iterator
+    {
+    private:
+        Table *table_;
+        std::size_t id_;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value*;
+        using reference = Value&;
+
+        basic_iterator() : table_(nullptr), id_(0) {}
+        basic_iterator(Table *table, std::size_t id) : table_(table), id_(id) {}
+
+        /* ID of the current value */
+        std::size_t id() const { return id_; }
+
+        reference operator*() const { return table_->data_[id_]; }
+        pointer operator->() const { return &table_->data_[id_]; }
+
+        basic_iterator& operator++() { id_ = table_->next_present(id_ + 1); return *this; }
+        basic_iterator operator++(int) { basic_iterator ret(*this); ++(*this); return ret; }
+
+        bool operator==(const basic_iterator& other) const { return id_ == other.id_; }
+        bool operator!=(const basic_iterator& other) const { return id_ != other.id_; }
+    };
+
+public:
+    using iterator = basic_iterator<IDTable, T>;
+    using const_iterator = basic_iterator<const IDTable, const T>;
+
+    IDTable() = default;
+
+    /* add or replace the value for the given ID */
+    T& insert(std::size_t id, const T& value)
+    {
+        reserve(id + 1);
+        data_[id] = value;
+        mark(id);
+        return data_[id];
+    }
+
+    T& insert(std::size_t id, T&& value)
+    {
+        reserve(id + 1);
+        data_[id] = std::move(value);
+        mark(id);
+        return data_[id];
+    }
+
+    /* make room for IDs below num_ids without reallocating later */
+    void reserve(std::size_t num_ids)
+    {
+        if(num_ids > data_.size())
+        {
+            data_.resize(num_ids);
+            present_.resize((num_ids + 63) / 64, 0);
+        }
+    }
+
+    bool contains(std::size_t id) const
+    {
+        return (id < data_.size()) && (present_[id / 64] & (uint64_t(1) << (id % 64)));
+    }
+
+    std::size_t count(std::size_t id) const { return contains(id) ? 1 : 0; }
+
+    /* returns nullptr if the ID isn't present */
+    T *find(std::size_t id) { return contains(id) ? &data_[id] : nullptr; }
+    const T *find(std::size_t id) const { return contains(id) ? &data_[id] : nullptr; }
+
+    /* throws ContainerError if the ID isn't present */
+    T& at(std::size_t id)
+    {
+        if(!contains(id))
+            throw ContainerError("ID not present in table");
+        return data_[id];
+    }
+
+    const T& at(std::size_t id) const
+    {
+        if(!contains(id))
+            throw ContainerError("ID not present in table");
+        return data_[id];
+    }
+
+    void clear()
+    {
+        data_.clear();
+        present_.clear();
+        size_ = 0;
+    }
+
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /* one past the highest ID the table can currently hold */
+    std::size_t capacity() const { return data_.size(); }
+
+    iterator begin() { return iterator(this, next_present(0)); }
+    iterator end() { return iterator(this, capacity()); }
+    const_iterator begin() const { return const_iterator(this, next_present(0)); }
+    const_iterator end() const { return const_iterator(this, capacity()); }
+};
+
+/* Fixed-capacity set of IDs in [0, Bits), stored as a bitmap.
+ * Mirrors the parts of the std::set interface we use, and iterates in ascending order
+ * just like std::set, so swapping one for the other doesn't change any RNG sequences.
+ * Union, intersection and difference work on whole words at a time.
+ * Inserting an ID that doesn't fit throws ContainerError. */
+template<std::size_t Bits>
+class IDBitset
+{
+private:
+    static constexpr std::size_t num_words_ = (Bits + 63) / 64;
+
+    uint64_t words_[num_words_] = {};
+
+    /* first ID >= id that is present in the set, or Bits if there is none */
+    std::size_t next_present(std::size_t id) const
+    {
+        std::size_t word = id / 64;
+        if(word >= num_words_)
+            return Bits;
+
+        uint64_t bits = words_[word] & (~uint64_t(0) << (id % 64));
+        while(!bits)
+        {
+            if(++word >= num_words_)
+                return Bits;
+            bits = words_[word];
+        }
+
+        return (word * 64) + count_trailing_zeros(bits);
+    }
+
+public:
+    class iterator
+    {
+    private:
+        const IDBitset *set_;
+        std::size_t id_;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = uint16_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const uint16_t*;
+        using reference = uint16_t;
+
+        iterator() : set_(nullptr), id_(0) {}
+        iterator(const IDBitset *set, std::size_t id) : set_(set), id_(id) {}
+
+        uint16_t operator*() const { return (uint16_t)id_; }
+
+        iterator& operator++() { id_ = set_->next_present(id_ + 1); return *this; }
+        iterator operator++(int) { iterator ret(*this); ++(*this); return ret; }
+
+        bool operator==(const iterator& other) const { return id_ == other.id_; }
+        bool operator!=(const iterator& other) const { return id_ != other.id_; }
+    };
+
+    using const_iterator = iterator;
+    using value_type = uint16_t;
+
+    IDBitset() = default;
+
+    template<typename It>
+    IDBitset(It first, It last) { insert(first, last); }
+
+    /* returns true if the ID wasn't already present */
+    bool insert(std::size_t id)
+    {
+        if(id >= Bits)
+            throw ContainerError("ID out of range for IDBitset");
+
+        uint64_t bit = uint64_t(1) << (id % 64);
+        bool ret = !(words_[id / 64] & bit);
+        words_[id / 64] |= bit;
+        return ret;
+    }
+
+    template<typename It>
+    void insert(It first, It last)
+    {
+        for(; first != last; ++first)
+            insert(*first);
+    }
+
+    /* returns the number of elements removed (0 or 1) */
+    std::size_t erase(std::size_t id)
+    {
+        if(!count(id))
+            return 0;
+
+        words_[id / 64] &= ~(uint64_t(1) << (id % 64));
+        return 1;
+    }
+
+    /* returns an iterator to the element following the erased one */
+    iterator erase(iterator it)
+    {
+        std::size_t id = *it;
+        ++it;
+        erase(id);
+        return it;
+    }
+
+    std::size_t count(std::size_t id) const
+    {
+        return ((id < Bits) && (words_[id / 64] & (uint64_t(1) << (id % 64)))) ? 1 : 0;
+    }
+
+    void clear()
+    {
+        for(auto& i : words_)
+            i = 0;
+    }
+
+    bool empty() const
+    {
+        for(auto i : words_)
+            if(i)
+                return false;
+
+        return true;
+    }
+
+    std::size_t size() const
+    {
+        std::size_t ret = 0;
+        for(auto i : words_)
+            ret += popcount(i);
+
         return ret;
     }
+
+    iterator begin() const { return iterator(this, next_present(0)); }
+    iterator end() const { return iterator(this, Bits); }
+
+    /* one past the highest ID the set can hold */
+    static constexpr std::size_t capacity() { return Bits; }
+
+    /* union */
+    IDBitset& operator|=(const IDBitset& other)
+    {
+        for(std::size_t i = 0; i < num_words_; ++i)
+            words_[i] |= other.words_[i];
+        return *this;
+    }
+
+    /* intersection */
+    IDBitset& operator&=(const IDBitset& other)
+    {
+        for(std::size_t i = 0; i < num_words_; ++i)
+            words_[i] &= other.words_[i];
+        return *this;
+    }
+
+    /* difference, removes every ID that is present in other */
+    IDBitset& operator-=(const IDBitset& other)
+    {
+        for(std::size_t i = 0; i < num_words_; ++i)
+            words_[i] &= ~other.words_[i];
+        return *this;
+    }
+
+    bool operator==(const IDBitset& other) const
+    {
+        for(std::size_t i = 0; i < num_words_; ++i)
+            if(words_[i] != other.words_[i])
+                return false;
+
+        return true;
+    }
+
+    bool operator!=(const IDBitset& other) const { return !(*this == other); }
 };
 
+/* skill, ability and item IDs in the unmodified games all comfortably fit in here.
+ * skillsets are stored per style, so going up to the full 16 bit range would cost 8KiB each.
+ * the parsers check IDs against capacity() instead and reject data that doesn't fit */
+typedef IDBitset<4096> IDSet;
+
 #endif // !CONTAINERS_H
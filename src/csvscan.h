@@ -0,0 +1,148 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CSVSCAN_H
+#define CSVSCAN_H
+#include "bitops.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* the vectorized csv scanners need x86, AVX2 is only used if the CPU supports it */
+#if !defined(CSV_NO_SSE) && !(defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#define CSV_NO_SSE
+#endif
+
+#ifndef CSV_NO_SSE
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CSV_TARGET_AVX2
+#else
+#define CSV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/* structural scanning for CSVFile.
+ * finds every ',' and '\r' in the text and writes their positions to 'out', in the style of simdjson's stage 1.
+ * works on both the UTF-8 buffer and the original shift-jis bytes, neither encoding uses those bytes inside
+ * a multibyte character. the vectorized versions are picked at runtime */
+typedef void (*CSVScanFunc)(const char *str, std::size_t len, std::vector<uint32_t>& out);
+
+/* scans str[begin, len) */
+inline void csv_scan_scalar(const char *str, std::size_t begin, std::size_t len, std::vector<uint32_t>& out)
+{
+    for(std::size_t i = begin; i < len; ++i)
+        if((str[i] == ',') || (str[i] == '\r'))
+            out.push_back((uint32_t)i);
+}
+
+#ifndef CSV_NO_SSE
+
+/* emit the positions of the set bits */
+inline void csv_emit_mask(uint64_t mask, std::size_t base, std::vector<uint32_t>& out)
+{
+    while(mask)
+    {
+        out.push_back((uint32_t)(base + count_trailing_zeros(mask)));
+        mask &= mask - 1;
+    }
+}
+
+inline void csv_scan_sse2(const char *str, std::size_t len, std::vector<uint32_t>& out)
+{
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i cr = _mm_set1_epi8('\r');
+    std::size_t pos = 0;
+
+    for(; (len - pos) >= 64; pos += 64)
+    {
+        uint64_t mask = 0;
+        for(int i = 0; i < 4; ++i)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i*)&str[pos + (i * 16)]);
+            __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, comma), _mm_cmpeq_epi8(block, cr));
+            mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(hits) << (i * 16);
+        }
+        csv_emit_mask(mask, pos, out);
+    }
+
+    csv_scan_scalar(str, pos, len, out);
+}
+
+CSV_TARGET_AVX2 inline void csv_scan_avx2(const char *str, std::size_t len, std::vector<uint32_t>& out)
+{
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    std::size_t pos = 0;
+
+    for(; (len - pos) >= 64; pos += 64)
+    {
+        __m256i block1 = _mm256_loadu_si256((const __m256i*)&str[pos]);
+        __m256i block2 = _mm256_loadu_si256((const __m256i*)&str[pos + 32]);
+        __m256i hits1 = _mm256_or_si256(_mm256_cmpeq_epi8(block1, comma), _mm256_cmpeq_epi8(block1, cr));
+        __m256i hits2 = _mm256_or_si256(_mm256_cmpeq_epi8(block2, comma), _mm256_cmpeq_epi8(block2, cr));
+        uint64_t mask = (uint64_t)(uint32_t)_mm256_movemask_epi8(hits1) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(hits2) << 32);
+        csv_emit_mask(mask, pos, out);
+    }
+
+    csv_scan_scalar(str, pos, len, out);
+}
+
+/* the OS has to save the AVX registers too, hence the xgetbv check */
+inline bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) /* OSXSAVE, AVX */
+        return false;
+
+    if((_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0; /* AVX2 */
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // CSV_NO_SSE
+
+inline CSVScanFunc csv_select_scanner()
+{
+#ifndef CSV_NO_SSE
+    if(cpu_has_avx2())
+        return csv_scan_avx2;
+    return csv_scan_sse2;
+#else
+    return [](const char *str, std::size_t len, std::vector<uint32_t>& out) { csv_scan_scalar(str, 0, len, out); };
+#endif
+}
+
+inline void csv_scan(const char *str, std::size_t len, std::vector<uint32_t>& out)
+{
+    static const CSVScanFunc scan = csv_select_scanner();
+    scan(str, len, out);
+}
+
+#endif // CSVSCAN_H
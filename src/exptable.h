@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EXPTABLE_H
+#define EXPTABLE_H
+#include <algorithm>
+
+/* exp needed for a level is level^3 * modifier / 100, the modifier depends on the puppet's cost */
+inline constexpr unsigned int g_cost_exp_modifiers[] = {70, 85, 100, 115, 130};
+inline constexpr unsigned int g_cost_exp_modifiers_ynk[] = {85, 92, 100, 107, 115};
+
+/* exp required to reach each level, for each cost modifier.
+ * padded out to a power of 2 so exp_table_level() can do a fixed number of binary search steps,
+ * levels past 100 are unreachable */
+struct ExpTable
+{
+    unsigned int exp[128];
+};
+
+constexpr ExpTable make_exp_table(unsigned int modifier)
+{
+    ExpTable table = {};
+    for(unsigned int level = 2; level < 128; ++level)
+        table.exp[level] = (level <= 100) ? (level * level * level * modifier / 100u) : 0xffffffffu;
+    return table;
+}
+
+inline constexpr ExpTable g_exp_tables[5] =
+{
+    make_exp_table(g_cost_exp_modifiers[0]), make_exp_table(g_cost_exp_modifiers[1]), make_exp_table(g_cost_exp_modifiers[2]),
+    make_exp_table(g_cost_exp_modifiers[3]), make_exp_table(g_cost_exp_modifiers[4])
+};
+
+inline constexpr ExpTable g_exp_tables_ynk[5] =
+{
+    make_exp_table(g_cost_exp_modifiers_ynk[0]), make_exp_table(g_cost_exp_modifiers_ynk[1]), make_exp_table(g_cost_exp_modifiers_ynk[2]),
+    make_exp_table(g_cost_exp_modifiers_ynk[3]), make_exp_table(g_cost_exp_modifiers_ynk[4])
+};
+
+/* costs past the end of the table are clamped */
+inline const ExpTable& exp_table(bool ynk, unsigned int cost)
+{
+    const ExpTable *tables = ynk ? g_exp_tables_ynk : g_exp_tables;
+    return tables[(cost < 4) ? cost : 4];
+}
+
+/* highest level (1 to 100) whose exp requirement is met */
+inline unsigned int exp_table_level(const ExpTable& table, unsigned int exp)
+{
+    /* table.exp[0] and table.exp[1] are both 0, so we always end up at level 1 or higher */
+    unsigned int ret = 0;
+    for(unsigned int step = 64; step; step >>= 1)
+        ret += (table.exp[ret + step] <= exp) ? step : 0;
+
+    return std::min(ret, 100u);
+}
+
+/* exp required to reach level. levels past 100 aren't in the table and are computed directly */
+inline unsigned int exp_table_exp(bool ynk, unsigned int cost, unsigned int level)
+{
+    if(level <= 1)
+        return 0;
+
+    if(level <= 100)
+        return exp_table(ynk, cost).exp[level];
+
+    const unsigned int *mods = ynk ? g_cost_exp_modifiers_ynk : g_cost_exp_modifiers;
+    return level * level * level * mods[(cost < 4) ? cost : 4] / 100u;
+}
+
+#endif // EXPTABLE_H
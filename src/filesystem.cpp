@@ -250,3 +250,45 @@ bool path_exists(const std::wstring& path)
     return (std::filesystem::exists(path, ec) && !ec);
 #endif
 }
+
+bool rename_file(const std::string& src, const std::string& dest)
+{
+#ifdef _WIN32
+    return (MoveFileExA(src.c_str(), dest.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+    std::error_code ec;
+    std::filesystem::rename(src, dest, ec);
+    return !ec;
+#endif // _WIN32
+}
+
+bool rename_file(const std::wstring& src, const std::wstring& dest)
+{
+#ifdef _WIN32
+    return (MoveFileExW(src.c_str(), dest.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+    std::error_code ec;
+    std::filesystem::rename(src, dest, ec);
+    return !ec;
+#endif // _WIN32
+}
+
+bool remove_file(const std::string& file)
+{
+#ifdef _WIN32
+    return (DeleteFileA(file.c_str()) != 0);
+#else
+    std::error_code ec;
+    return std::filesystem::remove(file, ec);
+#endif // _WIN32
+}
+
+bool remove_file(const std::wstring& file)
+{
+#ifdef _WIN32
+    return (DeleteFileW(file.c_str()) != 0);
+#else
+    std::error_code ec;
+    return std::filesystem::remove(file, ec);
+#endif // _WIN32
+}
@@ -40,4 +40,11 @@ bool write_file(const std::wstring& file, const void *buf, std::size_t len);
 bool path_exists(const std::string& path);
 bool path_exists(const std::wstring& path);
 
+/* replaces 'dest' if it already exists */
+bool rename_file(const std::string& src, const std::string& dest);
+bool rename_file(const std::wstring& src, const std::wstring& dest);
+
+bool remove_file(const std::string& file);
+bool remove_file(const std::wstring& file);
+
 #endif // FILESYSTEM_H
@@ -16,43 +16,50 @@
 */
 
 #include "gamedata.h"
-#include "endian.h"
+#include "csvscan.h"
 #include "textconvert.h"
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cctype>
+#include <charconv>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
 #include <utility>
 
 static const unsigned int g_style_levels[] = {0, 0, 0, 0, 30, 36, 42, 49, 56, 63, 70};
 static const unsigned int g_base_levels[] = {7, 10, 14, 19, 24};
 
-static const wchar_t *g_style_names[] = {
-    L"None",
-    L"Normal",
-    L"Power",
-    L"Defense",
-    L"Assist",
-    L"Speed",
-    L"Extra",
+static const char *g_style_names[] = {
+    "None",
+    "Normal",
+    "Power",
+    "Defense",
+    "Assist",
+    "Speed",
+    "Extra",
 };
 
-static const wchar_t *g_element_names[] = {
-    L"None",
-    L"Void",
-    L"Fire",
-    L"Water",
-    L"Nature",
-    L"Earth",
-    L"Steel",
-    L"Wind",
-    L"Electric",
-    L"Light",
-    L"Dark",
-    L"Nether",
-    L"Poison",
-    L"Fighting",
-    L"Illusion",
-    L"Sound",
-    L"Dream",
-    L"Warped",
+static const char *g_element_names[] = {
+    "None",
+    "Void",
+    "Fire",
+    "Water",
+    "Nature",
+    "Earth",
+    "Steel",
+    "Wind",
+    "Electric",
+    "Light",
+    "Dark",
+    "Nether",
+    "Poison",
+    "Fighting",
+    "Illusion",
+    "Sound",
+    "Dream",
+    "Warped",
 };
 
 static constexpr auto g_num_styles = sizeof(g_style_names) / sizeof(g_style_names[0]);
@@ -63,29 +70,12 @@ static_assert(STYLE_MAX == g_num_styles);
 
 void SkillData::read(const void *data)
 {
-    const uint8_t *buf = (const uint8_t*)data;
-
-    element = buf[32];
-    power = buf[33];
-    accuracy = buf[34];
-    sp = buf[35];
-    priority = buf[36];
-    type = read_le16(&buf[37]);
-    effect_id = read_le16(&buf[39]);
-    effect_chance = read_le16(&buf[41]);
-    effect_target = read_le16(&buf[43]);
+    layout_read(g_skill_layout, *this, data);
 }
 
 void SkillData::write(void *data)
 {
-    uint8_t *buf = (uint8_t*)data;
-
-    buf[32] = element;
-    buf[33] = power;
-    buf[34] = accuracy;
-    buf[35] = sp;
-    buf[36] = priority;
-    write_le16(&buf[37], type);
+    layout_write(g_skill_layout, *this, data);
 }
 
 StyleData::StyleData() : style_type(0), element1(0), element2(0), lv100_skill(0)
@@ -93,91 +83,38 @@ StyleData::StyleData() : style_type(0), element1(0), element2(0), lv100_skill(0)
     memset(base_stats, 0, sizeof(base_stats));
     memset(abilities, 0, sizeof(abilities));
     memset(style_skills, 0, sizeof(style_skills));
-    memset(skill_compat_table, 0, sizeof(skill_compat_table));
     memset(lv70_skills, 0, sizeof(lv70_skills));
 }
 
-void StyleData::read(const void *data)
-{
-    const uint8_t *buf = (const uint8_t*)data;
-
-    style_type = buf[0];
-    element1 = buf[1];
-    element2 = buf[2];
-
-    for(int i = 0; i < 6; ++i)
-        base_stats[i] = buf[3 + i];
-
-    abilities[0] = read_le16(&buf[9]);
-    abilities[1] = read_le16(&buf[11]);
-
-    for(int i = 0; i < 11; ++i)
-        style_skills[i] = read_le16(&buf[17 + (i * 2)]);
-
-    lv100_skill = read_le16(&buf[0x2D]);
-
-    for(int i = 0; i < 16; ++i)
-        skill_compat_table[i] = buf[49 + i];
-
-    for(int i = 0; i < 8; ++i)
-        lv70_skills[i] = read_le16(&buf[65 + (i * 2)]);
-}
-
-void StyleData::write(void * data)
-{
-    uint8_t *buf = (uint8_t*)data;
-
-    buf[0] = style_type;
-    buf[1] = element1;
-    buf[2] = element2;
-
-    for(int i = 0; i < 6; ++i)
-        buf[3 + i] = base_stats[i];
-
-    write_le16(&buf[9], abilities[0]);
-    write_le16(&buf[11], abilities[1]);
-
-    for(int i = 0; i < 11; ++i)
-        write_le16(&buf[17 + (i * 2)], style_skills[i]);
-
-    write_le16(&buf[0x2D], lv100_skill);
-
-    for(int i = 0; i < 16; ++i)
-        buf[49 + i] = skill_compat_table[i];
-
-    for(int i = 0; i < 8; ++i)
-        write_le16(&buf[65 + (i * 2)], lv70_skills[i]);
-}
-
-std::wstring StyleData::style_string() const
+std::string StyleData::style_string() const
 {
     assert(style_type < STYLE_MAX);
 
     if(style_type < g_num_styles)
         return g_style_names[style_type];
     else
-        return L"Unknown";
+        return "Unknown";
 
     /*
     switch(style_type)
     {
     case STYLE_NORMAL:
-        return L"Normal";
+        return "Normal";
     case STYLE_POWER:
-        return L"Power";
+        return "Power";
     case STYLE_DEFENSE:
-        return L"Defense";
+        return "Defense";
     case STYLE_ASSIST:
-        return L"Assist";
+        return "Assist";
     case STYLE_SPEED:
-        return L"Speed";
+        return "Speed";
     case STYLE_EXTRA:
-        return L"Extra";
+        return "Extra";
     case STYLE_NONE:
-        return L"None";
+        return "None";
     default:
         assert(false);
-        return L"UNKNOWN";
+        return "UNKNOWN";
     }
     */
 }
@@ -190,43 +127,6 @@ PuppetData::PuppetData()
     id = 0;
 }
 
-void PuppetData::read(const void *data)
-{
-    const uint8_t *buf = (const uint8_t*)data;
-
-    cost = buf[32];
-
-    for(int i = 0; i < 5; ++i)
-        base_skills[i] = read_le16(&buf[33 + (i * 2)]);
-
-    for(int i = 0; i < 4; ++i)
-        item_drop_table[i] = read_le16(&buf[43 + (i * 2)]);
-
-    /* there's an ID here, but it's wrong (?) */
-    id = read_le16(&buf[51]);
-
-    for(int i = 0; i < 4; ++i)
-        styles[i].read(&buf[93 + (i * STYLE_DATA_SIZE)]);
-}
-
-void PuppetData::write(void *data)
-{
-    uint8_t *buf = (uint8_t*)data;
-
-    buf[32] = cost;
-
-    for(int i = 0; i < 5; ++i)
-        write_le16(&buf[33 + (i * 2)], base_skills[i]);
-
-    for(int i = 0; i < 4; ++i)
-        write_le16(&buf[43 + (i * 2)], item_drop_table[i]);
-
-    //write_le16(&buf[51], id);
-
-    for(int i = 0; i < 4; ++i)
-        styles[i].write(&buf[93 + (i * STYLE_DATA_SIZE)]);
-}
-
 int PuppetData::level_to_learn(unsigned int style_index, unsigned int skill_id) const
 {
     if(skill_id == 0)
@@ -283,38 +183,278 @@ int PuppetData::max_style_index() const
     return result;
 }
 
-bool ItemData::parse(const CSVEntry& data, bool ynk)
+/* the PuppetTable column of each field of g_puppet_layout and g_style_layout, in the same order.
+ * decode(), encode(), get() and store() are all generated from these and the layouts */
+static constexpr auto g_puppet_columns = std::make_tuple(
+    &PuppetTable::cost,
+    &PuppetTable::base_skills,
+    &PuppetTable::item_drop_table);
+
+static constexpr auto g_style_columns = std::make_tuple(
+    &PuppetTable::style_type,
+    &PuppetTable::element1,
+    &PuppetTable::element2,
+    &PuppetTable::base_stats,
+    &PuppetTable::abilities,
+    &PuppetTable::style_skills,
+    &PuppetTable::lv100_skill,
+    &PuppetTable::skill_compat,
+    &PuppetTable::lv70_skills);
+
+void PuppetTable::decode(const void *data, std::size_t size)
 {
-    if((!ynk) && (data.size() != 11))
-        return false;
-    else if((ynk) && (data.size() != 12))
-        return false;
+    const uint8_t *buf = (const uint8_t*)data;
+    std::size_t n = size / PUPPET_DATA_SIZE;
 
-    if(data[0].empty() || !iswdigit(data[0][0]))
-        return false;
+    layout_resize_columns(g_puppet_columns, *this, n);
+    layout_resize_columns(g_style_columns, *this, n * 4);
+    dirty.assign(n, 0);
 
-    try
+    for(std::size_t i = 0; i < n; ++i)
     {
-        id = std::stoi(data[0]);
-        name = data[1];
-        price = std::stoi(data[2]);
-        type = std::stoi(data[3]);	/* 255 = unimplemented (id 0 "nothing" also uses this value) */
-        combat = (std::stoi(data[4]) != 0);
-        common = (std::stoi(data[5]) != 0);
-        can_discard = (std::stoi(data[6]) != 0);
-        held = (std::stoi(data[7]) != 0);
-        reincarnation = (std::stoi(data[8]) != 0);
-        skill_id = std::stoi(data[9]);
+        const uint8_t *rec = &buf[i * PUPPET_DATA_SIZE];
+
+        layout_read_columns(g_puppet_layout, g_puppet_columns, *this, i, rec);
+        for(std::size_t j = 0; j < 4; ++j)
+            layout_read_columns(g_style_layout, g_style_columns, *this, (i * 4) + j, &rec[PUPPET_STYLE_OFFSET + (j * STYLE_DATA_SIZE)]);
     }
-    catch(const std::exception&)
+}
+
+void PuppetTable::encode(void *data) const
+{
+    uint8_t *buf = (uint8_t*)data;
+
+    for(std::size_t i = 0; i < size(); ++i)
     {
+        if(!dirty[i])
+            continue;
+
+        uint8_t *rec = &buf[i * PUPPET_DATA_SIZE];
+
+        layout_write_columns(g_puppet_layout, g_puppet_columns, *this, i, rec);
+        for(std::size_t j = 0; j < 4; ++j)
+            layout_write_columns(g_style_layout, g_style_columns, *this, (i * 4) + j, &rec[PUPPET_STYLE_OFFSET + (j * STYLE_DATA_SIZE)]);
+    }
+}
+
+std::size_t PuppetTable::num_dirty() const
+{
+    return (std::size_t)std::count(dirty.begin(), dirty.end(), (uint8_t)1);
+}
+
+PuppetData PuppetTable::get(std::size_t id) const
+{
+    PuppetData puppet;
+
+    puppet.id = (uint16_t)id;
+    layout_copy_from_columns(g_puppet_layout, g_puppet_columns, *this, id, puppet);
+    for(std::size_t i = 0; i < 4; ++i)
+        layout_copy_from_columns(g_style_layout, g_style_columns, *this, (id * 4) + i, puppet.styles[i]);
+
+    return puppet;
+}
+
+void PuppetTable::set(const PuppetData& puppet)
+{
+    assert(puppet.id < size());
+
+    if(store(puppet))
+        dirty[puppet.id] = 1;
+}
+
+bool PuppetTable::store(const PuppetData& puppet)
+{
+    std::size_t id = puppet.id;
+    bool changed = layout_copy_to_columns(g_puppet_layout, g_puppet_columns, puppet, *this, id);
+
+    for(std::size_t i = 0; i < 4; ++i)
+        changed |= layout_copy_to_columns(g_style_layout, g_style_columns, puppet.styles[i], *this, (id * 4) + i);
+
+    return changed;
+}
+
+long parse_long(std::string_view str)
+{
+    /* same rules as std::stol: leading whitespace, optional sign, then at least one digit.
+     * anything after the digits is ignored */
+    std::size_t pos = 0;
+    while((pos < str.size()) && isspace((unsigned char)str[pos]))
+        ++pos;
+
+    bool negative = false;
+    if((pos < str.size()) && ((str[pos] == '-') || (str[pos] == '+')))
+        negative = (str[pos++] == '-');
+
+    if((pos >= str.size()) || (str[pos] < '0') || (str[pos] > '9'))
+        throw std::invalid_argument("parse_long");
+
+    unsigned long long val = 0;
+    for(; (pos < str.size()) && (str[pos] >= '0') && (str[pos] <= '9'); ++pos)
+    {
+        val = (val * 10) + (str[pos] - '0');
+        if(val > (unsigned long long)LONG_MAX + 1)
+            throw std::out_of_range("parse_long");
+    }
+
+    if(!negative && (val > (unsigned long long)LONG_MAX))
+        throw std::out_of_range("parse_long");
+
+    return negative ? (long)(0 - val) : (long)val;
+}
+
+/* parse_long without the exceptions, for the column parsers.
+ * leading whitespace and a '+' are skipped like std::stol does, std::from_chars does the rest */
+static bool parse_int(std::string_view str, int& out)
+{
+    std::size_t pos = 0;
+    while((pos < str.size()) && isspace((unsigned char)str[pos]))
+        ++pos;
+
+    if((pos < str.size()) && (str[pos] == '+'))
+    {
+        if((++pos < str.size()) && (str[pos] == '-'))
+            return false;
+    }
+
+    auto res = std::from_chars(str.data() + pos, str.data() + str.size(), out);
+    return (res.ec == std::errc());
+}
+
+/* ItemData.csv schema. ynk inserts a column in front of the description */
+#define ITEM_FIELD_NAME 1
+#define ITEM_FIELD_DESCRIPTION 10
+#define ITEM_FIELD_DESCRIPTION_YNK 11
+
+struct ItemIntColumn
+{
+    std::size_t field;
+    std::vector<int> ItemTable::*column;
+};
+
+struct ItemFlagColumn
+{
+    std::size_t field;
+    uint8_t flag;
+};
+
+static const ItemIntColumn g_item_int_columns[] =
+{
+    {0, &ItemTable::id},
+    {2, &ItemTable::price},
+    {3, &ItemTable::type},      /* 255 = unimplemented (id 0 "nothing" also uses this value) */
+    {9, &ItemTable::skill_id}
+};
+
+static const ItemFlagColumn g_item_flag_columns[] =
+{
+    {4, ITEM_COMBAT},
+    {5, ITEM_COMMON},
+    {6, ITEM_CAN_DISCARD},
+    {7, ITEM_HELD},
+    {8, ITEM_REINCARNATION}
+};
+
+bool ItemTable::parse(const CSVFile& csv, bool ynk)
+{
+    const ItemData defaults;
+    std::size_t lines = csv.num_lines();
+
+    id.assign(lines, defaults.id);
+    type.assign(lines, defaults.type);
+    price.assign(lines, defaults.price);
+    skill_id.assign(lines, defaults.skill_id);
+    flags.assign(lines, 0);
+    name.assign(lines, std::string_view());
+    description.assign(lines, std::string_view());
+
+    if(csv.num_fields() != (ynk ? 12u : 11u))
         return false;
+
+    std::size_t desc_field = ynk ? ITEM_FIELD_DESCRIPTION_YNK : ITEM_FIELD_DESCRIPTION;
+
+    for(std::size_t line = 0; line < lines; ++line)
+    {
+        /* skips the header and anything else that isn't an item */
+        std::string_view first = csv.get_field(line, 0);
+        if(first.empty() || !isdigit((unsigned char)first[0]))
+            continue;
+
+        int vals[std::size(g_item_int_columns)];
+        uint8_t item_flags = 0;
+        bool good = true;
+
+        for(std::size_t i = 0; good && (i < std::size(g_item_int_columns)); ++i)
+            good = parse_int(csv.get_field(line, g_item_int_columns[i].field), vals[i]);
+
+        for(std::size_t i = 0; good && (i < std::size(g_item_flag_columns)); ++i)
+        {
+            int val;
+            good = parse_int(csv.get_field(line, g_item_flag_columns[i].field), val);
+            if(good && (val != 0))
+                item_flags |= g_item_flag_columns[i].flag;
+        }
+
+        if(!good)
+            continue;
+
+        for(std::size_t i = 0; i < std::size(g_item_int_columns); ++i)
+            (this->*g_item_int_columns[i].column)[line] = vals[i];
+        flags[line] = item_flags;
+        name[line] = csv.get_field(line, ITEM_FIELD_NAME);
+        description[line] = csv.get_field(line, desc_field);
     }
 
-    if(!ynk)
-        description = data[10];
-    else
-        description = data[11];
+    return true;
+}
+
+ItemData ItemTable::row(std::size_t line) const
+{
+    ItemData item;
+
+    item.name = name[line];
+    item.description = description[line];
+    item.id = id[line];
+    item.type = type[line];
+    item.price = price[line];
+    item.combat = (flags[line] & ITEM_COMBAT) != 0;
+    item.common = (flags[line] & ITEM_COMMON) != 0;
+    item.can_discard = (flags[line] & ITEM_CAN_DISCARD) != 0;
+    item.held = (flags[line] & ITEM_HELD) != 0;
+    item.reincarnation = (flags[line] & ITEM_REINCARNATION) != 0;
+    item.skill_id = skill_id[line];
+
+    return item;
+}
+
+/* builds the field spans from the positions of the delimiters.
+ * only lines terminated by \r\n are used, commas past the expected field count are part of the last field.
+ * the fields of an unterminated last line are dropped. fails if a line has too few fields */
+bool CSVFile::split_fields(const char *str, std::size_t size, const std::vector<uint32_t>& structural, std::size_t num_splits, std::vector<Span>& out)
+{
+    std::size_t field_begin = 0, splits = 0;
+    for(std::size_t pos : structural)
+    {
+        if(str[pos] == ',')
+        {
+            if(splits < num_splits)
+            {
+                out.push_back({(uint32_t)field_begin, (uint32_t)(pos - field_begin)});
+                field_begin = pos + 1;
+                ++splits;
+            }
+        }
+        else if(((pos + 1) < size) && (str[pos + 1] == '\n'))
+        {
+            if(splits < num_splits)
+                return false;
+
+            out.push_back({(uint32_t)field_begin, (uint32_t)(pos - field_begin)});
+            field_begin = pos + 2;
+            splits = 0;
+        }
+    }
+
+    out.resize(out.size() - (out.size() % (num_splits + 1)));
 
     return true;
 }
@@ -323,168 +463,168 @@ bool CSVFile::parse(const void *data, std::size_t len)
 {
     clear();
 
-    std::wstring file = sjis_to_utf((const char*)data, len);
-
-    int num_splits = 0;
+    raw_.assign((const char*)data, len);
+    buf_ = sjis_to_utf8(raw_);
 
     /* determine field count from first line. */
-    for(auto& i : file)
+    std::size_t num_splits = 0;
+    for(auto i : buf_)
     {
-        if(i == L',')
+        if(i == ',')
             ++num_splits;
-        else if(i == L'\n')
+        else if(i == '\n')
             break;
     }
 
-    std::size_t str_begin = 0, str_end = file.find(L"\r\n");
-    while(str_end != std::wstring::npos)
-    {
-        CSVEntry entry;
-        std::size_t split_begin = str_begin, split_end = file.find(L',', str_begin);
-        for(int i = 0; i < num_splits; ++i)
-        {
-            if(split_end > str_end)
-            {
-                clear();
-                return false;
-            }
+    num_fields_ = num_splits + 1;
 
-            entry.push_back(std::move(file.substr(split_begin, split_end - split_begin)));
-            split_begin = split_end + 1;
-            split_end = file.find(L',', split_begin);
-        }
+    /* find all the delimiters in one pass, then build the fields from just those positions */
+    std::vector<uint32_t> structural;
+    structural.reserve(buf_.size() / 4);
+    csv_scan(buf_.data(), buf_.size(), structural);
 
-        entry.push_back(std::move(file.substr(split_begin, str_end - split_begin)));
-        value_map_.push_back(std::move(entry));
-        str_begin = str_end + 2;
-        str_end = file.find(L"\r\n", str_begin);
+    if(!split_fields(buf_.data(), buf_.size(), structural, num_splits, fields_))
+    {
+        clear();
+        return false;
     }
 
+    if(fields_.empty())
+        num_fields_ = 0;
+
     return true;
 }
 
+/* the field boundaries are found in the original bytes the same way as in the UTF-8 buffer,
+ * so they line up with fields_ one to one.
+ * the output is the original file up to the end of its last complete line, with the edited fields
+ * spliced in. its size is known before anything is written, so it's built in a single allocation */
 std::string CSVFile::to_string() const
 {
-    std::wstring temp;
+    /* every \r\n ends a line (lines with too few fields fail to parse), so this is the end of the last complete one */
+    std::size_t end = raw_.rfind("\r\n");
+    if(fields_.empty() || (end == std::string::npos))
+        return std::string();
+    end += 2;
 
-    for(const auto& i : value_map_)
-    {
-        if(i.empty())
-            continue;
+    if(edits_.empty())
+        return raw_.substr(0, end);
+
+    std::vector<uint32_t> structural;
+    structural.reserve(fields_.size());
+    csv_scan(raw_.data(), end, structural);
+
+    std::vector<Span> raw_fields;
+    raw_fields.reserve(fields_.size());
+    split_fields(raw_.data(), end, structural, num_fields_ - 1, raw_fields);
 
-        for(std::size_t j = 0; j < i.size() - 1; ++j)
+    /* decoding never merges or splits delimiters, but don't rely on it for malformed input */
+    if(raw_fields.size() != fields_.size())
+    {
+        std::string temp;
+        for(std::size_t line = 0; line < num_lines(); ++line)
         {
-            temp += i[j];
-            temp += L',';
+            for(std::size_t field = 0; field < num_fields_; ++field)
+            {
+                if(field)
+                    temp += ',';
+                temp += get_field(line, field);
+            }
+            temp += "\r\n";
         }
-        temp += i.back();
-        temp += L"\r\n";
+
+        return utf8_to_sjis(temp);
+    }
+
+    std::vector<std::pair<std::size_t, std::string>> encoded;
+    encoded.reserve(edits_.size());
+    for(const auto& it : edits_)
+        encoded.emplace_back(it.first, utf8_to_sjis(it.second));
+    std::sort(encoded.begin(), encoded.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::size_t size = end;
+    for(const auto& it : encoded)
+        size = size - raw_fields[it.first].len + it.second.size();
+
+    std::string out;
+    out.reserve(size);
+
+    std::size_t pos = 0;
+    for(const auto& it : encoded)
+    {
+        const Span& field = raw_fields[it.first];
+        out.append(raw_, pos, field.offset - pos);
+        out += it.second;
+        pos = field.offset + field.len;
     }
+    out.append(raw_, pos, end - pos);
 
-    return utf_to_sjis(temp);
+    return out;
 }
 
-std::wstring element_string(unsigned int element)
+std::string element_string(unsigned int element)
 {
     assert(element < ELEMENT_MAX);
 
     if(element < g_num_elements)
         return g_element_names[element];
     else
-        return L"Unknown";
+        return "Unknown";
 
     /*
     switch(element)
     {
     case ELEMENT_NONE:
-        return L"None";
+        return "None";
     case ELEMENT_VOID:
-        return L"Void";
+        return "Void";
     case ELEMENT_FIRE:
-        return L"Fire";
+        return "Fire";
     case ELEMENT_WATER:
-        return L"Water";
+        return "Water";
     case ELEMENT_NATURE:
-        return L"Nature";
+        return "Nature";
     case ELEMENT_EARTH:
-        return L"Earth";
+        return "Earth";
     case ELEMENT_STEEL:
-        return L"Steel";
+        return "Steel";
     case ELEMENT_WIND:
-        return L"Wind";
+        return "Wind";
     case ELEMENT_ELECTRIC:
-        return L"Electric";
+        return "Electric";
     case ELEMENT_LIGHT:
-        return L"Light";
+        return "Light";
     case ELEMENT_DARK:
-        return L"Dark";
+        return "Dark";
     case ELEMENT_NETHER:
-        return L"Nether";
+        return "Nether";
     case ELEMENT_POISON:
-        return L"Poison";
+        return "Poison";
     case ELEMENT_FIGHTING:
-        return L"Fighting";
+        return "Fighting";
     case ELEMENT_ILLUSION:
-        return L"Illusion";
+        return "Illusion";
     case ELEMENT_SOUND:
-        return L"Sound";
+        return "Sound";
     case ELEMENT_DREAM:
-        return L"Dream";
+        return "Dream";
     case ELEMENT_WARPED:
-        return L"Warped";
+        return "Warped";
     default:
         assert(false);
-        return L"Unknown";
+        return "Unknown";
     }
     */
 }
 
 void MADData::read(const void *data)
 {
-    const char *buf = (const char*)data;
-
-    /* area name */
-    memcpy(location_name, &buf[0x59], sizeof(location_name));
-
-    /* normal grass */
-    memcpy(puppet_ids, &buf[0x0E], sizeof(puppet_ids));
-    memcpy(puppet_levels, &buf[0x22], sizeof(puppet_levels));
-    memcpy(puppet_styles, &buf[0x2c], sizeof(puppet_styles));
-    memcpy(puppet_ratios, &buf[0x36], sizeof(puppet_ratios));
-
-    /* blue grass */
-    memcpy(special_puppet_ids, &buf[0x40], sizeof(special_puppet_ids));
-    memcpy(special_puppet_levels, &buf[0x4a], sizeof(special_puppet_levels));
-    memcpy(special_puppet_styles, &buf[0x4f], sizeof(special_puppet_styles));
-    memcpy(special_puppet_ratios, &buf[0x54], sizeof(special_puppet_ratios));
-
-    /* Bike and gap map */
-    memcpy(bike_disabled, &buf[0x0b], sizeof(bike_disabled));
-    memcpy(gap_map_disabled, &buf[0x79], sizeof(gap_map_disabled));
+    layout_read(g_mad_layout, *this, data);
 }
 
 void MADData::write(void *data)
 {
-    char *buf = (char*)data;
-
-    /* area name */
-    memcpy(&buf[0x59], location_name, sizeof(location_name));
-
-    /* normal grass */
-    memcpy(&buf[0x0E], puppet_ids, sizeof(puppet_ids));
-    memcpy(&buf[0x22], puppet_levels, sizeof(puppet_levels));
-    memcpy(&buf[0x2c], puppet_styles, sizeof(puppet_styles));
-    memcpy(&buf[0x36], puppet_ratios, sizeof(puppet_ratios));
-
-    /* blue grass */
-    memcpy(&buf[0x40], special_puppet_ids, sizeof(special_puppet_ids));
-    memcpy(&buf[0x4a], special_puppet_levels, sizeof(special_puppet_levels));
-    memcpy(&buf[0x4f], special_puppet_styles, sizeof(special_puppet_styles));
-    memcpy(&buf[0x54], special_puppet_ratios, sizeof(special_puppet_ratios));
-
-    /* Bike and gap map */
-    memcpy(&buf[0x0b], bike_disabled, sizeof(bike_disabled));
-    memcpy(&buf[0x79], gap_map_disabled, sizeof(gap_map_disabled));
+    layout_write(g_mad_layout, *this, data);
 }
 
 void MADData::clear_encounters()
@@ -17,17 +17,20 @@
 
 #ifndef GAMEDATA_H
 #define GAMEDATA_H
+#include "containers.h"
+#include "layout.h"
+#include "skillcompat.h"
+#include <array>
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
-#include <set>
 
 #define SKILL_DATA_SIZE 0x77
 #define STYLE_DATA_SIZE 0x65
 #define PUPPET_DATA_SIZE 0x1F1
 
-typedef std::vector<std::wstring> CSVEntry;
-
 enum PuppetStyleType
 {
     STYLE_NONE = 0,
@@ -98,17 +101,14 @@ public:
     uint16_t abilities[2];
     uint16_t style_skills[11];				/* lv. 0, 0, 0, 0, 30, 36, 42, 49, 56, 63, 70 */
     uint16_t lv100_skill;                   /* skill learned at level 100 */
-    uint8_t skill_compat_table[16];			/* bitfield of 128 boolean values indicating ability to learn skill cards */
+    SkillCompat skill_compat;				/* skill cards this style can learn */
     uint16_t lv70_skills[8];				/* extra skills at level 70 */
 
-    std::set<uint16_t> skillset;        /* set of all skills ids this puppet can learn by levelling (used internally, not present in game data) */
+    IDSet skillset;                     /* set of all skills ids this puppet can learn by levelling (used internally, not present in game data) */
 
     StyleData();
-    StyleData(const void *data) {read(data);}
 
-    void read(const void *data);
-    void write(void *data);
-    std::wstring style_string() const;
+    std::string style_string() const;
 };
 
 /* base data for a puppet (including styles) */
@@ -123,20 +123,91 @@ public:
     StyleData styles[4];
 
     PuppetData();
-    PuppetData(const void *data) {read(data);}
-
-    void read(const void *data);
-    void write(void *data);
 
     int level_to_learn(unsigned int style_index, unsigned int skill_id) const;  /* level required to learn a skill, returns -1 if puppet cannot learn the skill by levelling */
     int max_style_index() const;
 };
 
+/* record layouts, offsets are relative to the start of the record */
+inline constexpr auto g_skill_layout = make_layout(
+    layout_field(32, &SkillData::element),
+    layout_field(33, &SkillData::power),
+    layout_field(34, &SkillData::accuracy),
+    layout_field(35, &SkillData::sp),
+    layout_field(36, &SkillData::priority),
+    layout_field(37, &SkillData::type),
+    layout_field(39, &SkillData::effect_id),
+    layout_field(41, &SkillData::effect_chance),
+    layout_field(43, &SkillData::effect_target));
+
+inline constexpr auto g_style_layout = make_layout(
+    layout_field(0, &StyleData::style_type),
+    layout_field(1, &StyleData::element1),
+    layout_field(2, &StyleData::element2),
+    layout_field(3, &StyleData::base_stats),
+    layout_field(9, &StyleData::abilities),
+    layout_field(17, &StyleData::style_skills),
+    layout_field(0x2D, &StyleData::lv100_skill),
+    layout_field(49, &StyleData::skill_compat),
+    layout_field(65, &StyleData::lv70_skills));
+
+/* the styles follow at PUPPET_STYLE_OFFSET, one every STYLE_DATA_SIZE bytes.
+ * there's an id at offset 51 too, but it's wrong (?) so the position in the file is used instead */
+#define PUPPET_STYLE_OFFSET 93
+inline constexpr auto g_puppet_layout = make_layout(
+    layout_field(32, &PuppetData::cost),
+    layout_field(33, &PuppetData::base_skills),
+    layout_field(43, &PuppetData::item_drop_table));
+
+static_assert(layout_size(g_skill_layout) <= SKILL_DATA_SIZE, "SkillData layout overruns the record");
+static_assert(layout_size(g_style_layout) <= STYLE_DATA_SIZE, "StyleData layout overruns the record");
+static_assert(layout_size(g_puppet_layout) <= PUPPET_STYLE_OFFSET, "PuppetData layout overlaps the styles");
+static_assert((PUPPET_STYLE_OFFSET + (4 * STYLE_DATA_SIZE)) <= PUPPET_DATA_SIZE, "PuppetData styles overrun the record");
+
+/* all of dolldata.dbs, decoded column by column.
+ * puppet columns are indexed by record number, which is also the puppet id.
+ * style columns are indexed by record * 4 + style index */
+class PuppetTable
+{
+public:
+    std::vector<uint8_t> cost;
+    std::vector<std::array<uint16_t, 5>> base_skills;
+    std::vector<std::array<uint16_t, 4>> item_drop_table;
+
+    std::vector<uint8_t> style_type, element1, element2;
+    std::vector<std::array<uint8_t, 6>> base_stats;
+    std::vector<std::array<uint16_t, 2>> abilities;
+    std::vector<std::array<uint16_t, 11>> style_skills;
+    std::vector<uint16_t> lv100_skill;
+    std::vector<SkillCompat> skill_compat;
+    std::vector<std::array<uint16_t, 8>> lv70_skills;
+
+    std::vector<uint8_t> dirty;     /* record was changed by set() */
+
+private:
+    bool store(const PuppetData& puppet);   /* returns true if anything changed */
+
+public:
+    void decode(const void *data, std::size_t size);
+
+    /* writes back only the dirty records, data must be the buffer the table was decoded from */
+    void encode(void *data) const;
+
+    std::size_t size() const { return cost.size(); }
+    std::size_t num_styles() const { return style_type.size(); }
+    std::size_t num_dirty() const;
+
+    /* skillsets aren't part of the file, get() leaves them empty.
+     * set() only touches the record for puppet.id, so different puppets may be set concurrently */
+    PuppetData get(std::size_t id) const;
+    void set(const PuppetData& puppet);
+};
+
 /* base data for items */
 class ItemData
 {
 public:
-    std::wstring name, description;	/* description may contain escape sequences like "\n" */
+    std::string name, description;	/* description may contain escape sequences like "\n" */
     int id, type, price;			/* type = junk, consumable, etc. type 255 = unimplemented (id 0 (nothing) also uses type 255) */
     bool combat;					/* can be used in battle (healing items etc.) */
     bool common;					/* item is considered to be common (?) */
@@ -146,9 +217,6 @@ public:
     int skill_id;					/* (skill cards) id of the skill this item teaches */
 
     ItemData() : id(0), type(255), price(0), combat(false), common(false), can_discard(false), held(false), reincarnation(false), skill_id(0) {}
-    ItemData(const CSVEntry& data, bool ynk) { parse(data, ynk); }
-
-    bool parse(const CSVEntry& data, bool ynk);
 
     /* returns true if item is valid and usable in-game */
     inline bool is_valid() const { return (type < 255); }
@@ -214,40 +282,139 @@ public:
     void clear_encounters();
 };
 
-/* parses csv files and splits each field into a separate string */
+/* offsets from the start of the MAD file */
+inline constexpr auto g_mad_layout = make_layout(
+    layout_field(0x0b, &MADData::bike_disabled),
+    layout_field(0x0E, &MADData::puppet_ids),
+    layout_field(0x22, &MADData::puppet_levels),
+    layout_field(0x2c, &MADData::puppet_styles),
+    layout_field(0x36, &MADData::puppet_ratios),
+    layout_field(0x40, &MADData::special_puppet_ids),
+    layout_field(0x4a, &MADData::special_puppet_levels),
+    layout_field(0x4f, &MADData::special_puppet_styles),
+    layout_field(0x54, &MADData::special_puppet_ratios),
+    layout_field(0x59, &MADData::location_name),
+    layout_field(0x79, &MADData::gap_map_disabled));
+
+class CSVFile;
+
+/* read-only view of one line of a CSVFile */
+class CSVLine
+{
+private:
+    const CSVFile *csv_;
+    std::size_t line_;
+
+public:
+    CSVLine(const CSVFile *csv, std::size_t line) : csv_(csv), line_(line) {}
+
+    std::size_t size() const;
+    std::string_view operator[](std::size_t field) const;
+    std::string_view back() const { return (*this)[size() - 1]; }
+};
+
+/* parses csv files.
+ * the file is decoded to UTF-8 and kept in a single buffer, each field is stored as an (offset, length)
+ * span into it, so parsing doesn't allocate per field. fields are returned as views.
+ * modified fields go into an overlay on top of the buffer */
 class CSVFile
 {
 private:
-    std::vector<CSVEntry> value_map_;
+    struct Span
+    {
+        uint32_t offset, len;
+    };
+
+    std::string raw_;               /* the file as it was read (shift-jis) */
+    std::string buf_;               /* the file as UTF-8 */
+    std::vector<Span> fields_;      /* num_fields_ spans per line */
+    std::size_t num_fields_ = 0;
+    std::unordered_map<std::size_t, std::string> edits_;  /* index into fields_ -> new value */
+
+    static bool split_fields(const char *str, std::size_t size, const std::vector<uint32_t>& structural, std::size_t num_splits, std::vector<Span>& out);
 
 public:
+    class const_iterator
+    {
+    private:
+        const CSVFile *csv_;
+        std::size_t line_;
+
+    public:
+        const_iterator(const CSVFile *csv, std::size_t line) : csv_(csv), line_(line) {}
+
+        CSVLine operator*() const { return CSVLine(csv_, line_); }
+        const_iterator& operator++() { ++line_; return *this; }
+        bool operator==(const const_iterator& other) const { return line_ == other.line_; }
+        bool operator!=(const const_iterator& other) const { return line_ != other.line_; }
+    };
+
     CSVFile() {}
     CSVFile(const void *data, std::size_t len) { parse(data, len); }
 
     bool parse(const void *data, std::size_t len);
-    const CSVEntry& get_line(int id) const { return value_map_[id]; }
-    CSVEntry& get_line(int id) { return value_map_[id]; }
-    const CSVEntry& operator[](int id) const { return value_map_[id]; }
-    CSVEntry& operator[](int id) { return value_map_[id]; }
-    void clear() { value_map_.clear(); }
-
-    const std::vector<CSVEntry>& data() const { return value_map_; }
-    std::vector<CSVEntry>& data() { return value_map_; }
-    std::vector<CSVEntry>::const_iterator begin() const { return value_map_.cbegin(); }
-    std::vector<CSVEntry>::const_iterator end() const { return value_map_.cend(); }
-
-    auto& front() { return value_map_.front(); }
-    const auto& front() const { return value_map_.front(); }
-    auto& back() { return value_map_.back(); }
-    const auto& back() const { return value_map_.back(); }
-
-    std::size_t num_lines() const { return value_map_.size(); }
-    std::size_t num_fields() const { return value_map_.empty() ? 0 : value_map_[0].size(); }
-    const std::wstring& get_field(unsigned int line, unsigned int field) const { return value_map_[line][field]; }
+    void clear() { raw_.clear(); buf_.clear(); fields_.clear(); num_fields_ = 0; edits_.clear(); }
+
+    CSVLine get_line(std::size_t line) const { return CSVLine(this, line); }
+    CSVLine operator[](std::size_t line) const { return CSVLine(this, line); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, num_lines()); }
+
+    std::size_t num_lines() const { return num_fields_ ? (fields_.size() / num_fields_) : 0; }
+    std::size_t num_fields() const { return num_fields_; }
+
+    std::string_view get_field(std::size_t line, std::size_t field) const
+    {
+        std::size_t index = (line * num_fields_) + field;
+        if(!edits_.empty())
+        {
+            auto it = edits_.find(index);
+            if(it != edits_.end())
+                return it->second;
+        }
+
+        return std::string_view(&buf_[fields_[index].offset], fields_[index].len);
+    }
 
+    void set_field(std::size_t line, std::size_t field, std::string value) { edits_[(line * num_fields_) + field] = std::move(value); }
+
+    /* serializes back to shift-jis. unmodified fields are copied from the original bytes */
     std::string to_string() const;
 };
 
-std::wstring element_string(unsigned int element);
+inline std::size_t CSVLine::size() const { return csv_->num_fields(); }
+inline std::string_view CSVLine::operator[](std::size_t field) const { return csv_->get_field(line_, field); }
+
+/* std::stol for string views. throws std::invalid_argument or std::out_of_range */
+long parse_long(std::string_view str);
+
+enum ItemFlag
+{
+    ITEM_COMBAT = 1,
+    ITEM_COMMON = 2,
+    ITEM_CAN_DISCARD = 4,
+    ITEM_HELD = 8,
+    ITEM_REINCARNATION = 16
+};
+
+/* ItemData.csv stored column by column, one entry per csv line.
+ * numeric columns are read straight from the field bytes, the text columns are views
+ * into the CSVFile, which has to outlive the table. lines that don't parse keep the
+ * ItemData defaults (type 255), so they drop out of any filter on usable items */
+class ItemTable
+{
+public:
+    std::vector<int> id, type, price, skill_id;
+    std::vector<uint8_t> flags;                         /* ItemFlag */
+    std::vector<std::string_view> name, description;
+
+    /* fails only if the file doesn't have the expected number of columns */
+    bool parse(const CSVFile& csv, bool ynk);
+
+    std::size_t size() const { return id.size(); }
+    ItemData row(std::size_t line) const;
+};
+
+std::string element_string(unsigned int element);
 
 #endif // GAMEDATA_H
@@ -28,6 +28,7 @@ processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 #include <algorithm>
 #include <CommCtrl.h>
 #include <ShlObj.h>
+#include <commdlg.h>
 
 #define IS_CHECKED(chkbox) (SendMessageW(chkbox, BM_GETCHECK, 0, 0) == BST_CHECKED)
 #define SET_CHECKED(chkbox, checked) SendMessageW(chkbox, BM_SETCHECK, (checked) ? BST_CHECKED : BST_UNCHECKED, 0)
@@ -228,72 +229,75 @@ INT_PTR CALLBACK RandomizerGUI::DialogProc(HWND hwnd, UINT msg, WPARAM wParam, L
                     break;
                 }
 
-                if(MessageBoxW(hwnd, L"This will permanently modify game files.\r\nIf you have not backed up your game folder, you may wish to do so now.\r\n"
+                /* a patch leaves the game files alone */
+                if(!IS_CHECKED(gui->cb_write_patch_) && (MessageBoxW(hwnd, L"This will permanently modify game files.\r\nIf you have not backed up your game folder, you may wish to do so now.\r\n"
                     "Also note that randomization is cumulative. Re-randomizing the same game data may have unexpected results.",
-                    L"Notice", MB_OKCANCEL | MB_ICONINFORMATION) != IDOK)
+                    L"Notice", MB_OKCANCEL | MB_ICONINFORMATION) != IDOK))
                     break;
 
                 try
                 {
-                    Randomizer rnd(gui);
-
-                    rnd.rand_trainer_sc_shuffle_ = get_window_text(gui->wnd_sc_chance_).empty();
-                    rnd.stat_ratio_ = get_window_uint(gui->wnd_stat_ratio_);
-                    rnd.level_mod_ = get_window_uint(gui->wnd_lvladjust_);
-                    rnd.stat_quota_ = get_window_uint(gui->wnd_quota_);
-
-                    rnd.trainer_sc_chance_ = get_window_uint(gui->wnd_sc_chance_);
-                    if(rnd.trainer_sc_chance_ > 100)
-                        rnd.trainer_sc_chance_ = 100;
-
-                    rnd.trainer_item_chance_ = get_window_uint(gui->wnd_item_chance_);
-                    if(rnd.trainer_item_chance_ > 100)
-                        rnd.trainer_item_chance_ = 100;
-
-                    rnd.rand_skillsets_ = IS_CHECKED(gui->cb_skills_);
-                    rnd.rand_stats_ = IS_CHECKED(gui->cb_stats_);
-                    rnd.rand_trainers_ = IS_CHECKED(gui->cb_trainers_);
-                    rnd.rand_types_ = IS_CHECKED(gui->cb_types_);
-                    rnd.rand_compat_ = IS_CHECKED(gui->cb_compat_);
-                    rnd.rand_abilities_ = IS_CHECKED(gui->cb_abilities_);
-                    rnd.rand_full_party_ = IS_CHECKED(gui->cb_trainer_party_);
-                    rnd.rand_encounters_ = GET_3STATE(gui->cb_encounters_);
-                    rnd.rand_export_locations_ = IS_CHECKED(gui->cb_export_locations_);
-                    rnd.rand_quota_ = IS_CHECKED(gui->cb_use_quota_);
-                    rnd.rand_healthy_ = IS_CHECKED(gui->cb_healthy_);
-                    rnd.rand_skillcards_ = GET_3STATE(gui->cb_skillcards_);
-                    rnd.rand_true_rand_stats_ = IS_CHECKED(gui->cb_true_rand_stats_);
-                    rnd.rand_prefer_same_type_ = IS_CHECKED(gui->cb_prefer_same_type_);
-                    rnd.rand_export_puppets_ = IS_CHECKED(gui->cb_export_puppets_);
-                    rnd.rand_true_rand_skills_ = IS_CHECKED(gui->cb_true_rand_skills_);
-                    rnd.rand_cost_ = GET_3STATE(gui->cb_cost_);
-                    rnd.rand_skill_element_ = IS_CHECKED(gui->cb_skill_element_);
-                    rnd.rand_skill_power_ = IS_CHECKED(gui->cb_skill_power_);
-                    rnd.rand_skill_acc_ = IS_CHECKED(gui->cb_skill_acc_);
-                    rnd.rand_skill_sp_ = IS_CHECKED(gui->cb_skill_sp_);
-                    rnd.rand_skill_prio_ = IS_CHECKED(gui->cb_skill_prio_);
-                    rnd.rand_skill_type_ = IS_CHECKED(gui->cb_skill_type_);
-                    rnd.rand_starting_move_ = GET_3STATE(gui->cb_starting_move_);
-                    rnd.rand_stat_scaling_ = IS_CHECKED(gui->cb_proportional_stats_);
-                    rnd.rand_strict_trainers_ = IS_CHECKED(gui->cb_strict_trainers_);
-                    rnd.rand_export_compat_ = IS_CHECKED(gui->cb_export_compat_);
-                    rnd.rand_evolved_trainers_ = IS_CHECKED(gui->cb_evolved_trainers_);
-                    rnd.rand_trainer_ai_ = IS_CHECKED(gui->cb_trainer_ai_);
-                    rnd.rand_trainer_max_ivs_ = IS_CHECKED(gui->cb_trainer_ivs_);
-                    rnd.rand_trainer_max_evs_ = IS_CHECKED(gui->cb_trainer_evs_);
-                    rnd.rand_blind_trainers_ = IS_CHECKED(gui->cb_blind_trainers_);
-                    rnd.rand_bike_everywhere_ = IS_CHECKED(gui->cb_bike_everywhere_);
-                    rnd.rand_gap_map_everywhere_ = IS_CHECKED(gui->cb_gap_map_everywhere_);
-                    rnd.rand_costumes_ = GET_3STATE(gui->cb_costumes_);
+                    RandomizerOptions opts;
+
+                    opts.rand_trainer_sc_shuffle = get_window_text(gui->wnd_sc_chance_).empty();
+                    opts.stat_ratio = get_window_uint(gui->wnd_stat_ratio_);
+                    opts.level_mod = get_window_uint(gui->wnd_lvladjust_);
+                    opts.stat_quota = get_window_uint(gui->wnd_quota_);
+
+                    opts.trainer_sc_chance = get_window_uint(gui->wnd_sc_chance_);
+                    opts.trainer_item_chance = get_window_uint(gui->wnd_item_chance_);
+
+                    opts.rand_skillsets = IS_CHECKED(gui->cb_skills_);
+                    opts.rand_stats = IS_CHECKED(gui->cb_stats_);
+                    opts.rand_trainers = IS_CHECKED(gui->cb_trainers_);
+                    opts.rand_types = IS_CHECKED(gui->cb_types_);
+                    opts.rand_compat = IS_CHECKED(gui->cb_compat_);
+                    opts.rand_abilities = IS_CHECKED(gui->cb_abilities_);
+                    opts.rand_full_party = IS_CHECKED(gui->cb_trainer_party_);
+                    opts.rand_encounters = GET_3STATE(gui->cb_encounters_);
+                    opts.rand_export_locations = IS_CHECKED(gui->cb_export_locations_);
+                    opts.rand_quota = IS_CHECKED(gui->cb_use_quota_);
+                    opts.quota_shape = IS_CHECKED(gui->cb_balanced_quota_) ? QUOTA_BALANCED : QUOTA_FLAT;
+                    opts.rand_healthy = IS_CHECKED(gui->cb_healthy_);
+                    opts.rand_skillcards = GET_3STATE(gui->cb_skillcards_);
+                    opts.rand_true_rand_stats = IS_CHECKED(gui->cb_true_rand_stats_);
+                    opts.rand_prefer_same_type = IS_CHECKED(gui->cb_prefer_same_type_);
+                    opts.rand_export_puppets = IS_CHECKED(gui->cb_export_puppets_);
+                    opts.rand_true_rand_skills = IS_CHECKED(gui->cb_true_rand_skills_);
+                    opts.rand_cost = GET_3STATE(gui->cb_cost_);
+                    opts.rand_skill_element = IS_CHECKED(gui->cb_skill_element_);
+                    opts.rand_skill_power = IS_CHECKED(gui->cb_skill_power_);
+                    opts.rand_skill_acc = IS_CHECKED(gui->cb_skill_acc_);
+                    opts.rand_skill_sp = IS_CHECKED(gui->cb_skill_sp_);
+                    opts.rand_skill_prio = IS_CHECKED(gui->cb_skill_prio_);
+                    opts.rand_skill_type = IS_CHECKED(gui->cb_skill_type_);
+                    opts.rand_starting_move = GET_3STATE(gui->cb_starting_move_);
+                    opts.rand_stat_scaling = IS_CHECKED(gui->cb_proportional_stats_);
+                    opts.rand_strict_trainers = IS_CHECKED(gui->cb_strict_trainers_);
+                    opts.rand_export_compat = IS_CHECKED(gui->cb_export_compat_);
+                    opts.rand_evolved_trainers = IS_CHECKED(gui->cb_evolved_trainers_);
+                    opts.rand_trainer_ai = IS_CHECKED(gui->cb_trainer_ai_);
+                    opts.rand_trainer_max_ivs = IS_CHECKED(gui->cb_trainer_ivs_);
+                    opts.rand_trainer_max_evs = IS_CHECKED(gui->cb_trainer_evs_);
+                    opts.rand_blind_trainers = IS_CHECKED(gui->cb_blind_trainers_);
+                    opts.rand_bike_everywhere = IS_CHECKED(gui->cb_bike_everywhere_);
+                    opts.rand_gap_map_everywhere = IS_CHECKED(gui->cb_gap_map_everywhere_);
+                    opts.rand_costumes = GET_3STATE(gui->cb_costumes_);
+                    opts.write_patch = IS_CHECKED(gui->cb_write_patch_);
 
                     gui->generate_share_code();
 
+                    Randomizer rnd(gui, opts);
+
                     if(rnd.randomize(get_window_text(gui->wnd_dir_), get_window_uint(gui->wnd_seed_)))
                     {
                         auto code = utf_narrow(get_window_text(gui->wnd_share_));
                         write_file(get_window_text(gui->wnd_dir_) + L"/randomizer_code.txt", code.data(), code.size());
                         gui->set_progress_bar(100);
-                        MessageBoxW(hwnd, L"Complete!", L"Success", MB_OK);
+                        if(opts.write_patch)
+                            MessageBoxW(hwnd, L"Complete!\r\nThe patch was written to randomizer.patch in the game folder.", L"Success", MB_OK);
+                        else
+                            MessageBoxW(hwnd, L"Complete!", L"Success", MB_OK);
                     }
                     else
                         MessageBoxW(hwnd, L"An error occurred, randomization aborted", L"Error", MB_OK | MB_ICONERROR);
@@ -305,12 +309,55 @@ INT_PTR CALLBACK RandomizerGUI::DialogProc(HWND hwnd, UINT msg, WPARAM wParam, L
 
                 gui->set_progress_bar(0);
                 break;
+            case IDC_APPLY_PATCH:
+            {
+                std::wstring dir = get_window_text(gui->wnd_dir_);
+                if(!path_exists(dir))
+                {
+                    gui->error(L"Invalid folder selected, please locate the game folder");
+                    break;
+                }
+
+                wchar_t buf[MAX_PATH] = { 0 };
+                OPENFILENAMEW ofn = { 0 };
+                ofn.lStructSize = sizeof(ofn);
+                ofn.hwndOwner = hwnd;
+                ofn.lpstrFilter = L"Randomizer Patch (*.patch)\0*.patch\0All Files (*.*)\0*.*\0";
+                ofn.lpstrFile = buf;
+                ofn.nMaxFile = MAX_PATH;
+                ofn.lpstrTitle = L"Select Patch";
+                ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST | OFN_NOCHANGEDIR;
+
+                if(!GetOpenFileNameW(&ofn))
+                    break;
+
+                if(MessageBoxW(hwnd, L"This will permanently modify game files.\r\nIf you have not backed up your game folder, you may wish to do so now.\r\n"
+                    "The patch only applies to unmodified game files matching the ones it was made from.",
+                    L"Notice", MB_OKCANCEL | MB_ICONINFORMATION) != IDOK)
+                    break;
+
+                try
+                {
+                    Randomizer rnd(gui);
+
+                    if(rnd.apply_patch(dir, buf))
+                        MessageBoxW(hwnd, L"Complete!", L"Success", MB_OK);
+                    else
+                        MessageBoxW(hwnd, L"An error occurred, the patch was not applied", L"Error", MB_OK | MB_ICONERROR);
+                }
+                catch(const std::exception& ex)
+                {
+                    gui->error(utf_widen(ex.what()));
+                }
+            }
+            break;
             case IDC_STATS:
                 if(!IS_CHECKED(gui->cb_stats_))
                 {
                     SET_CHECKED(gui->cb_true_rand_stats_, false);
                     SET_CHECKED(gui->cb_use_quota_, false);
                     EnableWindow(gui->wnd_quota_, false);
+                    EnableWindow(gui->cb_balanced_quota_, false);
                     EnableWindow(gui->wnd_stat_ratio_, false);
                     SET_CHECKED(gui->cb_proportional_stats_, false);
                 }
@@ -319,6 +366,7 @@ INT_PTR CALLBACK RandomizerGUI::DialogProc(HWND hwnd, UINT msg, WPARAM wParam, L
             {
                 bool checked = IS_CHECKED(gui->cb_use_quota_);
                 EnableWindow(gui->wnd_quota_, checked);
+                EnableWindow(gui->cb_balanced_quota_, checked);
                 if(checked)
                 {
                     SET_CHECKED(gui->cb_stats_, true);
@@ -335,6 +383,7 @@ INT_PTR CALLBACK RandomizerGUI::DialogProc(HWND hwnd, UINT msg, WPARAM wParam, L
                 {
                     SET_CHECKED(gui->cb_stats_, true);
                     EnableWindow(gui->wnd_quota_, false);
+                    EnableWindow(gui->cb_balanced_quota_, false);
                     EnableWindow(gui->wnd_stat_ratio_, false);
                     SET_CHECKED(gui->cb_use_quota_, false);
                     SET_CHECKED(gui->cb_proportional_stats_, false);
@@ -387,6 +436,7 @@ INT_PTR CALLBACK RandomizerGUI::DialogProc(HWND hwnd, UINT msg, WPARAM wParam, L
                     {
                         SET_CHECKED(gui->cb_stats_, true);
                         EnableWindow(gui->wnd_quota_, false);
+                        EnableWindow(gui->cb_balanced_quota_, false);
                         SET_CHECKED(gui->cb_use_quota_, false);
                         SET_CHECKED(gui->cb_true_rand_stats_, false);
                     }
@@ -467,6 +517,7 @@ RandomizerGUI::RandomizerGUI(HINSTANCE hInstance)
     init_hwnd_member(bn_generate_, IDC_GENERATE_SEED);
     init_hwnd_member(bn_share_gen_, IDC_GENERATE_SHARE);
     init_hwnd_member(bn_share_load_, IDC_LOAD_SHARE);
+    init_hwnd_member(bn_apply_patch_, IDC_APPLY_PATCH);
 
     init_hwnd_member(wnd_dir_, IDC_FOLDER_BOX);
     init_hwnd_member(wnd_seed_, IDC_SEED_BOX);
@@ -493,6 +544,7 @@ RandomizerGUI::RandomizerGUI(HINSTANCE hInstance)
     init_hwnd_member(cb_encounters_, IDC_WILD_PUPPETS);
     init_hwnd_member(cb_export_locations_, IDC_EXPORT_LOCATIONS);
     init_hwnd_member(cb_use_quota_, IDC_STAT_QUOTA);
+    init_hwnd_member(cb_balanced_quota_, IDC_BALANCED_QUOTA);
     init_hwnd_member(cb_healthy_, IDC_HEALTHY);
     init_hwnd_member(cb_skillcards_, IDC_SKILLCARDS);
     init_hwnd_member(cb_true_rand_stats_, IDC_TRUE_RAND_STATS);
@@ -512,6 +564,7 @@ RandomizerGUI::RandomizerGUI(HINSTANCE hInstance)
     init_hwnd_member(cb_bike_everywhere_, IDC_BIKE_EVERYWHERE);
     init_hwnd_member(cb_gap_map_everywhere_, IDC_GAP_MAP_EVERYWHERE);
     init_hwnd_member(cb_costumes_, IDC_COSTUMES);
+    init_hwnd_member(cb_write_patch_, IDC_WRITE_PATCH);
 
     init_hwnd_member(progress_bar_, IDC_PROG_BAR);
 
@@ -520,6 +573,7 @@ RandomizerGUI::RandomizerGUI(HINSTANCE hInstance)
     set_window_text(wnd_dir_, L"C:\\game\\FocasLens\\幻想人形演舞");
     set_window_text(wnd_lvladjust_, L"100");
     set_window_text(wnd_quota_, L"500");
+    SET_CHECKED(cb_balanced_quota_, true);
     set_window_text(wnd_stat_ratio_, L"25");
     set_window_text(wnd_item_chance_, L"25");
 
@@ -544,6 +598,7 @@ RandomizerGUI::RandomizerGUI(HINSTANCE hInstance)
     set_tooltip(cb_export_locations_, L"Export the locations where each puppet can be caught in the wild.\r\nThis will be written to catch_locations.txt in the game folder.");
     set_tooltip(cb_use_quota_, L"When stat randomization is enabled, each puppet will recieve the same total sum of stat points (distributed randomly)\r\nThe number of stat points can be adjusted in the \"Stat quota\" field below");
     set_tooltip(wnd_quota_, L"When \"Use stat quota\" is enabled, this number dictates the total sum of stat points each puppet recieves");
+    set_tooltip(cb_balanced_quota_, L"When \"Use stat quota\" is enabled, stat points are spread fairly evenly and extreme stats are rare.\r\nWhen unchecked, every possible split of the quota (with no stat above 255) is equally likely, so lopsided stats are common");
     set_tooltip(cb_healthy_, L"Remove \"Frail Health\" from the ability pool");
     set_tooltip(cb_skillcards_, L"This is a 3-state checkbox. Click twice to get to the \"middle\" state.\nChecked: Skill Cards will teach random skills\r\nMiddle: Don't randomize sign skills");
     set_tooltip(cb_true_rand_stats_, L"Puppet base stats will be completely random");
@@ -568,6 +623,8 @@ RandomizerGUI::RandomizerGUI(HINSTANCE hInstance)
     set_tooltip(cb_blind_trainers_, L"Trainers will not initiate battle unless spoken to.");
     set_tooltip(cb_bike_everywhere_,L"Allow the use of the bike on all maps");
     set_tooltip(cb_gap_map_everywhere_,L"Allow the use of the gap map on all maps. /!\\This may break some events - use at your own risk!");
+    set_tooltip(cb_write_patch_, L"Write the changes to randomizer.patch in the game folder instead of modifying the game files.\r\nThe patch can be shared and applied to an unmodified copy of the game with \"Apply Patch\".");
+    set_tooltip(bn_apply_patch_, L"Apply a randomizer.patch to the game folder selected above");
     set_tooltip(cb_costumes_, L"This is a 3-state checkbox. Click twice to get to the \"middle\" state.\nChecked: randomized trainer puppet costumes\nMiddle: no wedding dresses");
 
     checkboxes_.push_back(cb_evolved_trainers_);
@@ -686,7 +743,9 @@ void RandomizerGUI::generate_share_code()
         base64_encode(quota) + L':' +
         (sc_shuffle ? L"" : base64_encode(sc_chance)) + L':' +
         base64_encode(item_chance) + L':' +
-        base64_encode(stat_variance);
+        base64_encode(stat_variance) + L':' +
+        base64_encode(RNG_VERSION) + L':' +
+        base64_encode((unsigned int)(IS_CHECKED(cb_balanced_quota_) ? QUOTA_BALANCED : QUOTA_FLAT));
 
     set_window_text(wnd_share_, code.c_str());
 }
@@ -758,6 +817,23 @@ bool RandomizerGUI::load_share_code()
         auto item_chance = base64_decode(code_segs.at(5));
         auto stat_variance = base64_decode(code_segs.at(6));
 
+        /* codes from before the RNG was made portable don't have this segment.
+         * a different RNG means the same seed won't produce the same game */
+        auto rng_version = (code_segs.size() > 7) ? base64_decode(code_segs.at(7)) : 0u;
+        if(rng_version != RNG_VERSION)
+        {
+            if(!msg_yesno(L"This code was made with a different random number generator than this version of the randomizer uses.\r\n"
+                "The settings will load correctly, but the same seed will produce a different game.\r\n"
+                "Would you like to load this code anyway?"))
+                return false;
+        }
+
+        /* the quota shape is kept out of the checkbox bitfield so older codes keep their layout.
+         * codes without it predate the option and used the default, balanced */
+        auto quota_shape = (code_segs.size() > 8) ? base64_decode(code_segs.at(8)) : (unsigned int)QUOTA_BALANCED;
+        if(quota_shape > QUOTA_BALANCED)
+            throw std::exception();
+
         assert((sizeof(bitfield) * 8) >= (checkboxes_.size() + (checkboxes_3state_.size() * 2)));
 
         for(std::size_t i = 0; i < checkboxes_.size(); ++i)
@@ -783,6 +859,7 @@ bool RandomizerGUI::load_share_code()
         set_window_text(wnd_seed_, std::to_wstring(seed).c_str());
         set_window_text(wnd_lvladjust_, std::to_wstring(lvl_mod).c_str());
         set_window_text(wnd_quota_, std::to_wstring(quota).c_str());
+        SET_CHECKED(cb_balanced_quota_, quota_shape == QUOTA_BALANCED);
         set_window_text(wnd_item_chance_, std::to_wstring(item_chance).c_str());
         set_window_text(wnd_stat_ratio_, std::to_wstring(stat_variance).c_str());
 
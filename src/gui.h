@@ -33,6 +33,7 @@ private:
     HWND bn_generate_;
     HWND bn_share_gen_;
     HWND bn_share_load_;
+    HWND bn_apply_patch_;
 
     HWND wnd_dir_;
     HWND wnd_seed_;
@@ -59,6 +60,7 @@ private:
     HWND cb_encounters_;
     HWND cb_export_locations_;
     HWND cb_use_quota_;
+    HWND cb_balanced_quota_;
     HWND cb_healthy_;
     HWND cb_skillcards_;
     HWND cb_true_rand_stats_;
@@ -78,6 +80,7 @@ private:
     HWND cb_bike_everywhere_;
     HWND cb_gap_map_everywhere_;
     HWND cb_costumes_;
+    HWND cb_write_patch_;
 
     HWND progress_bar_;
 
@@ -0,0 +1,81 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HASH_H
+#define HASH_H
+#include "endian.h"
+#include <cstdint>
+#include <cstddef>
+
+/* fast non-cryptographic 64 bit hash, used for cache keys.
+ * input is consumed 8 bytes at a time in little endian order, so the result
+ * is the same on every platform */
+class Hasher
+{
+private:
+    uint64_t h_;
+    uint64_t len_;
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    void mix(uint64_t v)
+    {
+        h_ ^= rotl(v * 0x87C37B91114253D5ull, 31) * 0x4CF5AD432745937Full;
+        h_ = rotl(h_, 27) * 5 + 0x52DCE729;
+    }
+
+public:
+    Hasher() : h_(0xCBF29CE484222325ull), len_(0) {}
+
+    Hasher& add(const void *data, std::size_t len)
+    {
+        const char *buf = (const char*)data;
+        std::size_t pos = 0;
+
+        for(; (len - pos) >= 8; pos += 8)
+            mix(read_le64(&buf[pos]));
+
+        uint64_t tail = 0;
+        for(std::size_t i = 0; pos < len; ++pos, i += 8)
+            tail |= uint64_t((uint8_t)buf[pos]) << i;
+        mix(tail);
+
+        len_ += len;
+        return *this;
+    }
+
+    Hasher& add(uint64_t val)
+    {
+        mix(val);
+        len_ += 8;
+        return *this;
+    }
+
+    uint64_t value() const
+    {
+        /* murmur3 finalizer */
+        uint64_t h = h_ ^ len_;
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+#endif // HASH_H
@@ -0,0 +1,113 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INTERN_H
+#define INTERN_H
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+typedef uint32_t Symbol;
+
+/* maps each distinct string to a small integer id.
+ * the text is copied into large blocks that never move, so the views returned by str()
+ * stay valid until clear(). symbol 0 is always the empty string */
+class StringPool
+{
+private:
+    static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char *block_ = nullptr;                     /* block currently being filled */
+    std::size_t block_used_ = BLOCK_SIZE;
+    std::size_t bytes_ = 0;
+    std::vector<std::string_view> strings_;     /* indexed by symbol */
+    std::unordered_map<std::string_view, Symbol> index_;
+
+    /* the views point into blocks_, copying them would leave the copy pointing at our text */
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    std::string_view store(std::string_view str)
+    {
+        char *dest;
+
+        if(str.size() > (BLOCK_SIZE / 4))
+        {
+            /* big strings get a block of their own so they don't waste the rest of the current one */
+            blocks_.emplace_back(new char[str.size()]);
+            dest = blocks_.back().get();
+        }
+        else
+        {
+            if(str.size() > (BLOCK_SIZE - block_used_))
+            {
+                blocks_.emplace_back(new char[BLOCK_SIZE]);
+                block_ = blocks_.back().get();
+                block_used_ = 0;
+            }
+
+            dest = &block_[block_used_];
+            block_used_ += str.size();
+        }
+
+        memcpy(dest, str.data(), str.size());
+        bytes_ += str.size();
+
+        return std::string_view(dest, str.size());
+    }
+
+public:
+    StringPool() { clear(); }
+    StringPool(StringPool&&) = default;
+    StringPool& operator=(StringPool&&) = default;
+
+    Symbol intern(std::string_view str)
+    {
+        auto it = index_.find(str);
+        if(it != index_.end())
+            return it->second;
+
+        Symbol sym = (Symbol)strings_.size();
+        std::string_view stored = store(str);
+        strings_.push_back(stored);
+        index_.emplace(stored, sym);
+
+        return sym;
+    }
+
+    std::string_view str(Symbol sym) const { return strings_[sym]; }
+
+    std::size_t size() const { return strings_.size(); }    /* number of symbols */
+    std::size_t bytes() const { return bytes_; }            /* total length of the interned text */
+
+    void clear()
+    {
+        blocks_.clear();
+        block_ = nullptr;
+        block_used_ = BLOCK_SIZE;
+        bytes_ = 0;
+        strings_.assign(1, std::string_view());
+        index_.clear();
+        index_.emplace(std::string_view(), 0);
+    }
+};
+
+#endif // INTERN_H
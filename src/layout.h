@@ -0,0 +1,333 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+#include "endian.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* compile time descriptions of the game's binary records.
+ * a layout lists the fields of a record, each one a member pointer and the byte offset
+ * of that member in the game data. a member is an integer or an array of integers,
+ * anything wider than a byte is stored little endian. width and count come from the member's type.
+ * class members encode themselves, they need load(), store(), operator!= and an encoded_size.
+ *
+ * fields are numbered in the order they're listed, bit i of a field mask stands for field i */
+
+#define LAYOUT_ALL_FIELDS (~(uint64_t)0)
+
+template<typename T, bool = std::is_class_v<T>>
+struct LayoutWidth
+{
+    static constexpr std::size_t value = sizeof(T);
+};
+
+template<typename T>
+struct LayoutWidth<T, true>
+{
+    static constexpr std::size_t value = T::encoded_size;
+};
+
+template<typename Record, typename Member>
+struct LayoutField
+{
+    typedef std::remove_all_extents_t<Member> value_type;
+    static_assert(std::is_integral_v<value_type> || std::is_class_v<value_type>, "layout fields must be integers, classes or arrays of them");
+    static_assert(std::rank_v<Member> <= 1, "layout fields can't be multidimensional arrays");
+
+    static constexpr std::size_t width = LayoutWidth<value_type>::value;
+    static constexpr std::size_t count = (std::rank_v<Member> == 0) ? 1 : std::extent_v<Member>;
+    static constexpr std::size_t size = width * count;
+
+    std::size_t offset;
+    Member Record::*member;
+
+    value_type *values(Record& rec) const
+    {
+        if constexpr(std::rank_v<Member> == 0)
+            return &(rec.*member);
+        else
+            return rec.*member;
+    }
+
+    const value_type *values(const Record& rec) const
+    {
+        if constexpr(std::rank_v<Member> == 0)
+            return &(rec.*member);
+        else
+            return rec.*member;
+    }
+
+    void read(Record& rec, const uint8_t *buf) const
+    {
+        read_values(values(rec), buf);
+    }
+
+    void write(const Record& rec, uint8_t *buf) const
+    {
+        write_values(values(rec), buf);
+    }
+
+    /* same as read() and write() for count values stored somewhere other than a Record */
+    void read_values(value_type *dest, const uint8_t *buf) const
+    {
+        const uint8_t *src = &buf[offset];
+
+        if constexpr(std::is_class_v<value_type>)
+            for(std::size_t i = 0; i < count; ++i)
+                dest[i].load(&src[i * width]);
+        else if constexpr(width == 1)
+            memcpy(dest, src, count);
+        else
+            for(std::size_t i = 0; i < count; ++i)
+                dest[i] = load(&src[i * width]);
+    }
+
+    void write_values(const value_type *src, uint8_t *buf) const
+    {
+        uint8_t *dest = &buf[offset];
+
+        if constexpr(std::is_class_v<value_type>)
+            for(std::size_t i = 0; i < count; ++i)
+                src[i].store(&dest[i * width]);
+        else if constexpr(width == 1)
+            memcpy(dest, src, count);
+        else
+            for(std::size_t i = 0; i < count; ++i)
+                store(&dest[i * width], src[i]);
+    }
+
+    bool equal(const Record& a, const Record& b) const
+    {
+        return equal_values(a, values(b));
+    }
+
+    bool equal_values(const Record& rec, const value_type *vals) const
+    {
+        const value_type *src = values(rec);
+        for(std::size_t i = 0; i < count; ++i)
+            if(src[i] != vals[i])
+                return false;
+        return true;
+    }
+
+    /* copy the field between a Record and count values stored elsewhere */
+    void copy_to(const Record& rec, value_type *dest) const
+    {
+        const value_type *src = values(rec);
+        for(std::size_t i = 0; i < count; ++i)
+            dest[i] = src[i];
+    }
+
+    void copy_from(Record& rec, const value_type *src) const
+    {
+        value_type *dest = values(rec);
+        for(std::size_t i = 0; i < count; ++i)
+            dest[i] = src[i];
+    }
+
+private:
+    static value_type load(const uint8_t *src)
+    {
+        static_assert((width == 2) || (width == 4), "unsupported field width");
+        if constexpr(width == 2)
+            return (value_type)read_le16(src);
+        else
+            return (value_type)read_le32(src);
+    }
+
+    static void store(uint8_t *dest, value_type val)
+    {
+        if constexpr(width == 2)
+            write_le16(dest, (uint16_t)val);
+        else
+            write_le32(dest, (uint32_t)val);
+    }
+};
+
+template<typename... Fields>
+struct Layout
+{
+    static_assert(sizeof...(Fields) <= 64, "field masks only have 64 bits");
+    static constexpr std::size_t num_fields = sizeof...(Fields);
+
+    std::tuple<Fields...> fields;
+};
+
+template<typename Record, typename Member>
+constexpr LayoutField<Record, Member> layout_field(std::size_t offset, Member Record::*member)
+{
+    return LayoutField<Record, Member>{offset, member};
+}
+
+template<typename... Fields>
+constexpr Layout<Fields...> make_layout(Fields... fields)
+{
+    return Layout<Fields...>{std::tuple<Fields...>(fields...)};
+}
+
+/* number of bytes covered by the layout, i.e. the end of its last field */
+template<typename... Fields>
+constexpr std::size_t layout_size(const Layout<Fields...>& layout)
+{
+    return std::apply([](const auto&... f)
+    {
+        std::size_t end = 0;
+        ((end = ((f.offset + f.size) > end) ? (f.offset + f.size) : end), ...);
+        return end;
+    }, layout.fields);
+}
+
+template<typename Record, typename... Fields>
+void layout_read(const Layout<Fields...>& layout, Record& rec, const void *data)
+{
+    const uint8_t *buf = (const uint8_t*)data;
+    std::apply([&](const auto&... f) { (f.read(rec, buf), ...); }, layout.fields);
+}
+
+/* writes only the fields selected by mask, the rest of data is left untouched */
+template<typename Record, typename... Fields>
+void layout_write(const Layout<Fields...>& layout, const Record& rec, void *data, uint64_t mask = LAYOUT_ALL_FIELDS)
+{
+    uint8_t *buf = (uint8_t*)data;
+    std::size_t i = 0;
+    std::apply([&](const auto&... f) { ((((mask >> i++) & 1) ? f.write(rec, buf) : (void)0), ...); }, layout.fields);
+}
+
+/* mask of the fields that differ between a and b */
+template<typename Record, typename... Fields>
+uint64_t layout_diff(const Layout<Fields...>& layout, const Record& a, const Record& b)
+{
+    uint64_t mask = 0;
+    std::size_t i = 0;
+    std::apply([&](const auto&... f) { ((mask |= ((uint64_t)!f.equal(a, b) << i++)), ...); }, layout.fields);
+    return mask;
+}
+
+/* column storage: a table keeps one std::vector per field, each entry holding the field's value
+ * (or a std::array of them for array fields). columns is a tuple of those vector members,
+ * listed in the same order as the layout's fields */
+template<typename T>
+struct LayoutColumnEntry
+{
+    typedef T value_type;
+    static constexpr std::size_t count = 1;
+    static T *values(T& entry) { return &entry; }
+    static const T *values(const T& entry) { return &entry; }
+};
+
+template<typename T, std::size_t N>
+struct LayoutColumnEntry<std::array<T, N>>
+{
+    typedef T value_type;
+    static constexpr std::size_t count = N;
+    static T *values(std::array<T, N>& entry) { return entry.data(); }
+    static const T *values(const std::array<T, N>& entry) { return entry.data(); }
+};
+
+template<typename Field, typename Entry>
+typename Field::value_type *layout_column_values(const Field&, std::vector<Entry>& column, std::size_t index)
+{
+    static_assert(std::is_same_v<typename LayoutColumnEntry<Entry>::value_type, typename Field::value_type>, "column type doesn't match its field");
+    static_assert(LayoutColumnEntry<Entry>::count == Field::count, "column size doesn't match its field");
+    return LayoutColumnEntry<Entry>::values(column[index]);
+}
+
+template<typename Field, typename Entry>
+const typename Field::value_type *layout_column_values(const Field&, const std::vector<Entry>& column, std::size_t index)
+{
+    static_assert(std::is_same_v<typename LayoutColumnEntry<Entry>::value_type, typename Field::value_type>, "column type doesn't match its field");
+    static_assert(LayoutColumnEntry<Entry>::count == Field::count, "column size doesn't match its field");
+    return LayoutColumnEntry<Entry>::values(column[index]);
+}
+
+template<typename Table, typename Fields, typename Columns, std::size_t... I>
+void layout_read_columns(const Fields& fields, const Columns& columns, Table& table, std::size_t index, const uint8_t *buf, std::index_sequence<I...>)
+{
+    (std::get<I>(fields).read_values(layout_column_values(std::get<I>(fields), table.*std::get<I>(columns), index), buf), ...);
+}
+
+template<typename Table, typename Fields, typename Columns, std::size_t... I>
+void layout_write_columns(const Fields& fields, const Columns& columns, const Table& table, std::size_t index, uint8_t *buf, std::index_sequence<I...>)
+{
+    (std::get<I>(fields).write_values(layout_column_values(std::get<I>(fields), table.*std::get<I>(columns), index), buf), ...);
+}
+
+template<typename Record, typename Table, typename Fields, typename Columns, std::size_t... I>
+bool layout_copy_to_columns(const Fields& fields, const Columns& columns, const Record& rec, Table& table, std::size_t index, std::index_sequence<I...>)
+{
+    bool changed = false;
+    ([&](const auto& f, auto *dest)
+    {
+        changed |= !f.equal_values(rec, dest);
+        f.copy_to(rec, dest);
+    }(std::get<I>(fields), layout_column_values(std::get<I>(fields), table.*std::get<I>(columns), index)), ...);
+    return changed;
+}
+
+template<typename Record, typename Table, typename Fields, typename Columns, std::size_t... I>
+void layout_copy_from_columns(const Fields& fields, const Columns& columns, const Table& table, std::size_t index, Record& rec, std::index_sequence<I...>)
+{
+    (std::get<I>(fields).copy_from(rec, layout_column_values(std::get<I>(fields), table.*std::get<I>(columns), index)), ...);
+}
+
+/* resizes every column to n entries */
+template<typename Table, typename... Columns>
+void layout_resize_columns(const std::tuple<Columns...>& columns, Table& table, std::size_t n)
+{
+    std::apply([&](const auto&... c) { ((table.*c).resize(n), ...); }, columns);
+}
+
+/* copies a Record into entry index of every column, returns true if any entry changed */
+template<typename Record, typename Table, typename... Fields, typename... Columns>
+bool layout_copy_to_columns(const Layout<Fields...>& layout, const std::tuple<Columns...>& columns, const Record& rec, Table& table, std::size_t index)
+{
+    static_assert(sizeof...(Fields) == sizeof...(Columns), "need one column per field");
+    return layout_copy_to_columns(layout.fields, columns, rec, table, index, std::index_sequence_for<Fields...>());
+}
+
+/* copies entry index of every column into a Record */
+template<typename Record, typename Table, typename... Fields, typename... Columns>
+void layout_copy_from_columns(const Layout<Fields...>& layout, const std::tuple<Columns...>& columns, const Table& table, std::size_t index, Record& rec)
+{
+    static_assert(sizeof...(Fields) == sizeof...(Columns), "need one column per field");
+    layout_copy_from_columns(layout.fields, columns, table, index, rec, std::index_sequence_for<Fields...>());
+}
+
+/* reads a record into entry index of every column, without going through a Record */
+template<typename Table, typename... Fields, typename... Columns>
+void layout_read_columns(const Layout<Fields...>& layout, const std::tuple<Columns...>& columns, Table& table, std::size_t index, const void *data)
+{
+    static_assert(sizeof...(Fields) == sizeof...(Columns), "need one column per field");
+    layout_read_columns(layout.fields, columns, table, index, (const uint8_t*)data, std::index_sequence_for<Fields...>());
+}
+
+template<typename Table, typename... Fields, typename... Columns>
+void layout_write_columns(const Layout<Fields...>& layout, const std::tuple<Columns...>& columns, const Table& table, std::size_t index, void *data)
+{
+    static_assert(sizeof...(Fields) == sizeof...(Columns), "need one column per field");
+    layout_write_columns(layout.fields, columns, table, index, (uint8_t*)data, std::index_sequence_for<Fields...>());
+}
+
+#endif // LAYOUT_H
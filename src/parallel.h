@@ -0,0 +1,138 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* Run func(i) for every i in [0, count) on a set of worker threads.
+ * Work items are handed out one at a time, so func must not depend on the order
+ * in which items are processed.
+ * progress(done) is called on the calling thread only, each time more items have
+ * completed. this keeps GUI calls off the worker threads.
+ * If any invocation of func throws, the remaining items are abandoned and the
+ * first exception is rethrown on the calling thread once all workers have exited. */
+template<typename Func, typename Progress>
+void parallel_for(std::size_t count, Func&& func, Progress&& progress)
+{
+    if(count == 0)
+        return;
+
+    std::size_t num_threads = std::thread::hardware_concurrency();
+    if(num_threads == 0)
+        num_threads = 1;
+    num_threads = std::min(num_threads, count);
+
+    std::atomic<std::size_t> next(0);
+    std::size_t done = 0;
+    std::size_t exited = 0;
+    std::exception_ptr ex;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    auto worker = [&]()
+    {
+        for(;;)
+        {
+            std::size_t i = next++;
+            if(i >= count)
+                break;
+
+            try
+            {
+                func(i);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if(!ex)
+                    ex = std::current_exception();
+                next = count; /* stop handing out work */
+            }
+
+            std::lock_guard<std::mutex> lock(mtx);
+            ++done;
+            cv.notify_one();
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        ++exited;
+        cv.notify_one();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+
+    try
+    {
+        for(std::size_t i = 0; i < num_threads; ++i)
+            threads.emplace_back(worker);
+    }
+    catch(...)
+    {
+        /* couldn't start a thread. let whatever did start finish the job */
+        if(threads.empty())
+        {
+            worker();
+            if(ex)
+                std::rethrow_exception(ex);
+            progress(count);
+            return;
+        }
+    }
+
+    std::size_t reported = 0;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        for(;;)
+        {
+            cv.wait(lock, [&]() { return (done != reported) || (exited >= threads.size()); });
+            if(done == reported)
+                break; /* all workers have exited */
+
+            reported = done;
+            if(ex)
+                continue;
+
+            lock.unlock();
+            progress(reported);
+            lock.lock();
+        }
+    }
+
+    for(auto& i : threads)
+        i.join();
+
+    if(ex)
+        std::rethrow_exception(ex);
+}
+
+template<typename Func>
+void parallel_for(std::size_t count, Func&& func)
+{
+    parallel_for(count, std::forward<Func>(func), [](std::size_t) {});
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,223 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "patch.h"
+#include "endian.h"
+#include "filesystem.h"
+#include <cstring>
+#include <utility>
+
+static void put_u16(std::vector<char>& out, uint16_t val)
+{
+    char buf[2];
+    write_le16(buf, val);
+    out.insert(out.end(), buf, buf + sizeof(buf));
+}
+
+static void put_u32(std::vector<char>& out, uint32_t val)
+{
+    char buf[4];
+    write_le32(buf, val);
+    out.insert(out.end(), buf, buf + sizeof(buf));
+}
+
+static void put_u64(std::vector<char>& out, uint64_t val)
+{
+    char buf[8];
+    write_le64(buf, val);
+    out.insert(out.end(), buf, buf + sizeof(buf));
+}
+
+static void put_string(std::vector<char>& out, const std::string& str)
+{
+    put_u16(out, (uint16_t)str.size());
+    out.insert(out.end(), str.begin(), str.end());
+}
+
+/* bounds checked reads from a patch file */
+class PatchReader
+{
+private:
+    const char *buf_;
+    std::size_t len_, pos_;
+
+    const char *take(std::size_t sz)
+    {
+        if((len_ - pos_) < sz)
+            throw PatchError("Patch file is truncated.");
+        const char *ret = &buf_[pos_];
+        pos_ += sz;
+        return ret;
+    }
+
+public:
+    PatchReader(const char *buf, std::size_t len) : buf_(buf), len_(len), pos_(0) {}
+
+    uint16_t u16() { return read_le16(take(2)); }
+    uint32_t u32() { return read_le32(take(4)); }
+    uint64_t u64() { return read_le64(take(8)); }
+
+    std::string string()
+    {
+        std::size_t sz = u16();
+        return std::string(take(sz), sz);
+    }
+
+    std::vector<char> bytes(std::size_t sz)
+    {
+        const char *data = take(sz);
+        return std::vector<char>(data, data + sz);
+    }
+};
+
+void PatchTarget::add_file(const std::string& path, const void *src, std::size_t len, bool compress)
+{
+    PatchEntry entry;
+    entry.path = path;
+    entry.flags = 0;
+    entry.size = (uint32_t)len;
+
+    if(compress)
+        entry.payload = Archive::compress(src, len);
+
+    if(compress && (entry.payload.size() < len))
+        entry.flags |= PATCH_FLAG_COMPRESSED;
+    else
+        entry.payload.assign((const char*)src, (const char*)src + len);
+
+    for(auto& it : entries)
+    {
+        if(it.path == path)
+        {
+            it = std::move(entry);
+            return;
+        }
+    }
+
+    entries.push_back(std::move(entry));
+}
+
+void PatchTarget::apply(Archive& arc) const
+{
+    if(arc.content_hash() != base_hash)
+        throw PatchError("The game files don't match the ones the patch was made from.");
+
+    std::vector<ArcFile> files;
+    files.reserve(entries.size());
+
+    for(const auto& entry : entries)
+    {
+        int index = arc.get_index(entry.path);
+        if(index < 0)
+            throw PatchError("Patched file not found in archive: " + entry.path);
+
+        if(entry.size > PATCH_MAX_FILE_SIZE)
+            throw PatchError("Patch file is corrupt.");
+
+        char *buf = new char[entry.size];
+        files.push_back(ArcFile(buf, entry.size, index));
+
+        if(entry.flags & PATCH_FLAG_COMPRESSED)
+        {
+            if(Archive::decompress(entry.payload.data(), entry.payload.size(), buf, entry.size) != entry.size)
+                throw PatchError("Patch file is corrupt.");
+        }
+        else
+        {
+            if(entry.payload.size() != entry.size)
+                throw PatchError("Patch file is corrupt.");
+            memcpy(buf, entry.payload.data(), entry.size);
+        }
+    }
+
+    if(!arc.repack_files(files))
+        throw PatchError("Error repacking patched files into " + archive);
+}
+
+PatchTarget& Patch::add_target(const std::string& archive, uint64_t base_hash)
+{
+    targets_.emplace_back();
+    targets_.back().archive = archive;
+    targets_.back().base_hash = base_hash;
+    return targets_.back();
+}
+
+void Patch::open(const std::wstring& filename)
+{
+    targets_.clear();
+
+    std::size_t sz;
+    auto buf = read_file(filename, sz);
+    if(buf == nullptr)
+        throw PatchError("File I/O read error.");
+
+    PatchReader reader(buf.get(), sz);
+
+    if(reader.u32() != PATCH_MAGIC)
+        throw PatchError("Not a patch file.");
+
+    if(reader.u32() != PATCH_VERSION)
+        throw PatchError("Unsupported patch version.");
+
+    uint32_t num_targets = reader.u32();
+    for(uint32_t i = 0; i < num_targets; ++i)
+    {
+        std::string archive = reader.string();
+        uint64_t base_hash = reader.u64();
+        auto& target = add_target(archive, base_hash);
+
+        uint32_t num_entries = reader.u32();
+        for(uint32_t j = 0; j < num_entries; ++j)
+        {
+            PatchEntry entry;
+            entry.path = reader.string();
+            entry.flags = reader.u32();
+            entry.size = reader.u32();
+            if(entry.size > PATCH_MAX_FILE_SIZE)
+                throw PatchError("Patch file is corrupt.");
+            entry.payload = reader.bytes(reader.u32());
+            target.entries.push_back(std::move(entry));
+        }
+    }
+}
+
+bool Patch::save(const std::wstring& filename) const
+{
+    std::vector<char> out;
+
+    put_u32(out, PATCH_MAGIC);
+    put_u32(out, PATCH_VERSION);
+    put_u32(out, (uint32_t)targets_.size());
+
+    for(const auto& target : targets_)
+    {
+        put_string(out, target.archive);
+        put_u64(out, target.base_hash);
+        put_u32(out, (uint32_t)target.entries.size());
+
+        for(const auto& entry : target.entries)
+        {
+            put_string(out, entry.path);
+            put_u32(out, entry.flags);
+            put_u32(out, entry.size);
+            put_u32(out, (uint32_t)entry.payload.size());
+            out.insert(out.end(), entry.payload.begin(), entry.payload.end());
+        }
+    }
+
+    return write_file(filename, out.data(), out.size());
+}
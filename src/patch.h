@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PATCH_H
+#define PATCH_H
+#include "archive.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* patch files hold only the files the randomizer replaced, instead of whole archives.
+ *
+ * layout (all integers little endian):
+ *   header:  u32 magic, u32 version, u32 number of archives
+ *   archive: u16 name length, name, u64 base hash, u32 number of entries
+ *   entry:   u16 path length, path, u32 flags, u32 size, u32 stored size, payload
+ *
+ * the base hash is Archive::content_hash() of the archive the patch was made from,
+ * a patch can only be applied to that exact archive */
+#define PATCH_MAGIC 0x48435450 /* "PTCH" */
+#define PATCH_VERSION 1
+#define PATCH_FLAG_COMPRESSED 1 /* payload is compressed with Archive::compress() */
+#define PATCH_MAX_FILE_SIZE (64 * 1024 * 1024) /* far larger than any game file, anything bigger is a corrupt patch */
+
+struct PatchError : public std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+class PatchEntry
+{
+public:
+    std::string path;           /* path of the file inside the archive */
+    uint32_t flags;
+    uint32_t size;              /* uncompressed size */
+    std::vector<char> payload;
+};
+
+class PatchTarget
+{
+public:
+    std::string archive;        /* archive file name, relative to the game's dat folder */
+    uint64_t base_hash;
+    std::vector<PatchEntry> entries;
+
+    /* replaces any earlier entry for the same path.
+     * the payload is only stored compressed if that makes it smaller */
+    void add_file(const std::string& path, const void *src, std::size_t len, bool compress);
+
+    /* replace the patched files in arc, which must be the archive the patch was made from.
+     * throws PatchError on failure */
+    void apply(Archive& arc) const;
+};
+
+class Patch
+{
+private:
+    std::vector<PatchTarget> targets_;
+
+public:
+    PatchTarget& add_target(const std::string& archive, uint64_t base_hash);
+    const std::vector<PatchTarget>& targets() const { return targets_; }
+
+    /* throws PatchError on failure */
+    void open(const std::wstring& filename);
+
+    bool save(const std::wstring& filename) const;
+};
+
+#endif // PATCH_H
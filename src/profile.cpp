@@ -0,0 +1,157 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "profile.h"
+
+#ifdef TPDP_PROFILE
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+struct ProfileRecord
+{
+    const char *name;
+    double wall_ms;
+    double cpu_ms;
+    uint64_t alloc_bytes;
+    uint64_t alloc_count;
+    uint64_t counters[PROFILE_COUNTER_MAX];
+};
+
+/* counters are updated from any thread, scopes are expected on the main thread only */
+static std::atomic<uint64_t> g_alloc_bytes(0);
+static std::atomic<uint64_t> g_alloc_count(0);
+static std::atomic<uint64_t> g_counters[PROFILE_COUNTER_MAX];
+static std::mutex g_records_mtx;
+static std::vector<ProfileRecord> g_records;
+
+/* count every allocation made through operator new.
+ * the array and nothrow versions forward to this one */
+void *operator new(std::size_t size)
+{
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+
+    void *ptr = std::malloc(size ? size : 1);
+    if(ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+/* cpu time of the whole process, so work done on worker threads is included */
+static double process_cpu_ms()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if(!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0.0;
+
+    uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (double)(k + u) / 10000.0; /* 100ns units */
+#else
+    return (double)std::clock() * 1000.0 / CLOCKS_PER_SEC;
+#endif
+}
+
+ProfileSnapshot ProfileSnapshot::now()
+{
+    ProfileSnapshot ret;
+
+    ret.wall = std::chrono::steady_clock::now();
+    ret.cpu_ms = process_cpu_ms();
+    ret.alloc_bytes = g_alloc_bytes.load(std::memory_order_relaxed);
+    ret.alloc_count = g_alloc_count.load(std::memory_order_relaxed);
+    for(int i = 0; i < PROFILE_COUNTER_MAX; ++i)
+        ret.counters[i] = g_counters[i].load(std::memory_order_relaxed);
+
+    return ret;
+}
+
+ProfileScope::~ProfileScope()
+{
+    ProfileSnapshot end = ProfileSnapshot::now();
+    ProfileRecord rec;
+
+    rec.name = name_;
+    rec.wall_ms = std::chrono::duration<double, std::milli>(end.wall - start_.wall).count();
+    rec.cpu_ms = end.cpu_ms - start_.cpu_ms;
+    rec.alloc_bytes = end.alloc_bytes - start_.alloc_bytes;
+    rec.alloc_count = end.alloc_count - start_.alloc_count;
+    for(int i = 0; i < PROFILE_COUNTER_MAX; ++i)
+        rec.counters[i] = end.counters[i] - start_.counters[i];
+
+    std::lock_guard<std::mutex> lock(g_records_mtx);
+    g_records.push_back(rec);
+}
+
+void profile_add(ProfileCounter counter, uint64_t n)
+{
+    g_counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+void profile_reset()
+{
+    std::lock_guard<std::mutex> lock(g_records_mtx);
+    g_records.clear();
+}
+
+/* scopes are listed in the order they finished. nested scopes are inclusive,
+ * so an outer scope also counts everything recorded by the scopes inside it */
+std::string profile_report()
+{
+    std::lock_guard<std::mutex> lock(g_records_mtx);
+    std::string out = "{\n  \"scopes\": [";
+    char buf[512];
+
+    for(std::size_t i = 0; i < g_records.size(); ++i)
+    {
+        const auto& rec = g_records[i];
+        snprintf(buf, sizeof(buf),
+                 "%s\n    {\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"alloc_bytes\": %llu, \"allocations\": %llu, "
+                 "\"repack_bytes\": %llu, \"repack_files\": %llu, \"entries\": %llu}",
+                 i ? "," : "", rec.name, rec.wall_ms, rec.cpu_ms,
+                 (unsigned long long)rec.alloc_bytes, (unsigned long long)rec.alloc_count,
+                 (unsigned long long)rec.counters[PROFILE_REPACK_BYTES], (unsigned long long)rec.counters[PROFILE_REPACK_FILES],
+                 (unsigned long long)rec.counters[PROFILE_ENTRIES]);
+        out += buf;
+    }
+
+    out += "\n  ]\n}\n";
+
+    return out;
+}
+
+#endif // TPDP_PROFILE
@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* optional instrumentation, only compiled in when TPDP_PROFILE is defined.
+ * otherwise all of the macros below expand to nothing.
+ *
+ * PROFILE_SCOPE(name)      records wall time, cpu time, allocations and counters
+ *                          from here until the end of the enclosing block
+ * PROFILE_ADD(counter, n)  add n to one of the ProfileCounter counters
+ * PROFILE_RESET()          discard everything recorded so far
+ *
+ * profile_report() returns the recorded scopes as a JSON document */
+
+enum ProfileCounter
+{
+    PROFILE_REPACK_BYTES = 0,   /* archive bytes copied or moved by repacking */
+    PROFILE_REPACK_FILES,       /* number of files repacked */
+    PROFILE_ENTRIES,            /* records or files processed */
+    PROFILE_COUNTER_MAX
+};
+
+#ifdef TPDP_PROFILE
+#include <cstdint>
+#include <string>
+#include <chrono>
+
+struct ProfileSnapshot
+{
+    std::chrono::steady_clock::time_point wall;
+    double cpu_ms;
+    uint64_t alloc_bytes;
+    uint64_t alloc_count;
+    uint64_t counters[PROFILE_COUNTER_MAX];
+
+    static ProfileSnapshot now();
+};
+
+class ProfileScope
+{
+private:
+    const char *name_;
+    ProfileSnapshot start_;
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+public:
+    explicit ProfileScope(const char *name) : name_(name), start_(ProfileSnapshot::now()) {}
+    ~ProfileScope();
+};
+
+void profile_add(ProfileCounter counter, uint64_t n);
+void profile_reset();
+std::string profile_report();
+
+#define PROFILE_SCOPE(name) ProfileScope profile_scope_(name)
+#define PROFILE_ADD(counter, n) profile_add(counter, (uint64_t)(n))
+#define PROFILE_RESET() profile_reset()
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_ADD(counter, n) ((void)0)
+#define PROFILE_RESET() ((void)0)
+
+#endif // TPDP_PROFILE
+
+#endif // PROFILE_H
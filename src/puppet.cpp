@@ -21,6 +21,11 @@
 #include <cstdio>
 #include "textconvert.h"
 #include "endian.h"
+#include "layout.h"
+
+#ifndef PUPPET_NO_SSE
+#include <emmintrin.h>
+#endif
 
 Puppet::Puppet()
 {
@@ -32,44 +37,57 @@ Puppet::Puppet()
     hp = 0x0B;
 }
 
+/* the ivs are packed two to a byte at 0x54, everything else is described here */
+struct PuppetLayout
+{
+    static constexpr auto common = make_layout(
+        layout_field(0x00, &Puppet::trainer_id),
+        layout_field(0x04, &Puppet::secret_id),
+        layout_field(0x08, &Puppet::trainer_name_raw_),
+        layout_field(0x28, &Puppet::catch_location),
+        layout_field(0x2a, &Puppet::caught_year),
+        layout_field(0x2b, &Puppet::caught_month),
+        layout_field(0x2c, &Puppet::caught_day),
+        layout_field(0x2d, &Puppet::caught_hour),
+        layout_field(0x2e, &Puppet::caught_minute),
+        layout_field(0x2f, &Puppet::puppet_nickname_raw_),
+        layout_field(0x4f, &Puppet::puppet_id),
+        layout_field(0x51, &Puppet::style_index),
+        layout_field(0x52, &Puppet::ability_index),
+        layout_field(0x53, &Puppet::mark),
+        layout_field(0x57, &Puppet::unknown_0x57),
+        layout_field(0x58, &Puppet::exp),
+        layout_field(0x5c, &Puppet::happiness),
+        layout_field(0x5e, &Puppet::pp),
+        layout_field(0x60, &Puppet::costume_index),
+        layout_field(0x61, &Puppet::evs),
+        layout_field(0x67, &Puppet::held_item_id),
+        layout_field(0x69, &Puppet::skills),
+        layout_field(0x71, &Puppet::unknown_0x71));
+
+    /* party puppets only */
+    static constexpr auto party = make_layout(
+        layout_field(0x95, &Puppet::level),
+        layout_field(0x96, &Puppet::hp),
+        layout_field(0x98, &Puppet::sp),
+        layout_field(0x9c, &Puppet::status_effects),
+        layout_field(0x9e, &Puppet::unknown_0x9e));
+};
+
+static_assert(layout_size(PuppetLayout::common) <= PUPPET_SIZE, "Puppet layout overruns the record");
+static_assert(layout_size(PuppetLayout::party) <= PUPPET_SIZE_PARTY, "Puppet party layout overruns the record");
+
 void Puppet::read(const void *data, bool party)
 {
     const uint8_t *buf = (const uint8_t*)data;
 
-    trainer_id = read_le32(buf);
-    secret_id = read_le32(&buf[4]);
-    memcpy(trainer_name_raw_, &buf[8], sizeof(trainer_name_raw_));
-    catch_location = read_le16(&buf[0x28]);
-    caught_year = buf[0x2a];
-    caught_month = buf[0x2b];
-    caught_day = buf[0x2c];
-    caught_hour = buf[0x2d];
-    caught_minute = buf[0x2e];
-    memcpy(puppet_nickname_raw_, &buf[0x2f], sizeof(puppet_nickname_raw_));
-    puppet_id = read_le16(&buf[0x4f]);
-    style_index = buf[0x51];
-    ability_index = buf[0x52];
-    mark = buf[0x53];
+    layout_read(PuppetLayout::common, *this, buf);
     for(int i = 0; i < 6; ++i)
         ivs[i] = (buf[0x54 + (i / 2)] >> ((i % 2) * 4)) & 0x0f;
-    unknown_0x57 = buf[0x57];
-    exp = read_le32(&buf[0x58]);
-    happiness = read_le16(&buf[0x5c]);
-    pp = read_le16(&buf[0x5e]);
-    costume_index = buf[0x60];
-    memcpy(evs, &buf[0x61], sizeof(evs));
-    held_item_id = read_le16(&buf[0x67]);
-    for(int i = 0; i < 4; ++i)
-        skills[i] = read_le16(&buf[0x69 + (i * 2)]);
-    memcpy(unknown_0x71, &buf[0x71], sizeof(unknown_0x71));
 
     if(party)
     {
-        level = buf[0x95];
-        hp = read_le16(&buf[0x96]);
-        memcpy(sp, &buf[0x98], sizeof(sp));
-        memcpy(status_effects, &buf[0x9c], sizeof(status_effects));
-        unknown_0x9e = buf[0x9e];
+        layout_read(PuppetLayout::party, *this, buf);
     }
     else
     {
@@ -85,67 +103,96 @@ void Puppet::write(void *data, bool party) const
 {
     uint8_t *buf = (uint8_t*)data;
 
-    write_le32(buf, trainer_id);
-    write_le32(&buf[4], secret_id);
-    memcpy(&buf[8], trainer_name_raw_, sizeof(trainer_name_raw_));
-    write_le16(&buf[0x28], catch_location);
-    buf[0x2a] = caught_year;
-    buf[0x2b] = caught_month;
-    buf[0x2c] = caught_day;
-    buf[0x2d] = caught_hour;
-    buf[0x2e] = caught_minute;
-    memcpy(&buf[0x2f], puppet_nickname_raw_, sizeof(puppet_nickname_raw_));
-    write_le16(&buf[0x4f], puppet_id);
-    buf[0x51] = style_index;
-    buf[0x52] = ability_index;
-    buf[0x53] = mark;
+    layout_write(PuppetLayout::common, *this, buf);
     memset(&buf[0x54], 0, 3);
     for(int i = 0; i < 6; ++i)
         buf[0x54 + (i / 2)] |= (ivs[i] << ((i % 2) * 4));
-    buf[0x57] = unknown_0x57;
-    write_le32(&buf[0x58], exp);
-    write_le16(&buf[0x5c], happiness);
-    write_le16(&buf[0x5e], pp);
-    buf[0x60] = costume_index;
-    memcpy(&buf[0x61], evs, sizeof(evs));
-    write_le16(&buf[0x67], held_item_id);
-    for(int i = 0; i < 4; ++i)
-        write_le16(&buf[0x69 + (i * 2)], skills[i]);
-    memcpy(&buf[0x71], unknown_0x71, sizeof(unknown_0x71));
 
     if(party)
-    {
-        buf[0x95] = level;
-        write_le16(&buf[0x96], hp);
-        memcpy(&buf[0x98], sp, sizeof(sp));
-        memcpy(&buf[0x9c], status_effects, sizeof(status_effects));
-        buf[0x9e] = unknown_0x9e;
-    }
+        layout_write(PuppetLayout::party, *this, buf);
 }
 
-std::wstring Puppet::trainer_name() const
+std::string Puppet::trainer_name() const
 {
-    return sjis_to_utf(trainer_name_raw_);
+    return sjis_to_utf8(trainer_name_raw_);
 }
 
-void Puppet::set_trainer_name(const std::wstring& name)
+void Puppet::set_trainer_name(std::string_view name)
 {
-    std::string str = utf_to_sjis(name);
+    std::string str = utf8_to_sjis(name);
     snprintf(trainer_name_raw_, 32, "%s", str.c_str());
 }
 
-std::wstring Puppet::puppet_nickname() const
+std::string Puppet::puppet_nickname() const
 {
-    return sjis_to_utf(puppet_nickname_raw_);
+    return sjis_to_utf8(puppet_nickname_raw_);
 }
 
-void Puppet::set_puppet_nickname(const std::wstring& name)
+void Puppet::set_puppet_nickname(std::string_view name)
 {
-    std::string str = utf_to_sjis(name);
+    std::string str = utf8_to_sjis(name);
     snprintf(puppet_nickname_raw_, 32, "%s", str.c_str());
 }
 
-void Puppet::set_puppet_nickname(const std::string& name)
+PuppetCipher::PuppetCipher()
+{
+    memset(mask_, 0, sizeof(mask_));
+    memset(delta_, 0, sizeof(delta_));
+}
+
+void PuppetCipher::init(const void *rand_data)
 {
-    snprintf(puppet_nickname_raw_, 32, "%s", name.c_str());
+    const uint8_t *randbuf = (const uint8_t*)rand_data;
+
+    memset(mask_, 0, sizeof(mask_));
+    memset(delta_, 0, sizeof(delta_));
+
+    /* only every third byte is encrypted */
+    for(unsigned int i = 0; i < (PUPPET_SIZE / 3); ++i)
+    {
+        uint32_t crypto = read_le32(&randbuf[(i * 4) & 0x3fff]);
+
+        mask_[i * 3] = ((crypto % 3) == 0) ? 0xff : 0;
+        delta_[i * 3] = uint8_t(crypto);
+    }
+}
+
+/* decryption is b = (b ^ mask) - delta, encryption is the reverse.
+ * SSE2 handles 16 bytes at a time, whatever is left over is done one byte at a time */
+void PuppetCipher::decrypt(void *data) const
+{
+    uint8_t *buf = (uint8_t*)data;
+    std::size_t pos = 0;
+
+#ifndef PUPPET_NO_SSE
+    for(; (PUPPET_SIZE - pos) >= 16; pos += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)&buf[pos]);
+        block = _mm_xor_si128(block, _mm_loadu_si128((const __m128i*)&mask_[pos]));
+        block = _mm_sub_epi8(block, _mm_loadu_si128((const __m128i*)&delta_[pos]));
+        _mm_storeu_si128((__m128i*)&buf[pos], block);
+    }
+#endif
+
+    for(; pos < PUPPET_SIZE; ++pos)
+        buf[pos] = uint8_t((buf[pos] ^ mask_[pos]) - delta_[pos]);
+}
+
+void PuppetCipher::encrypt(void *data) const
+{
+    uint8_t *buf = (uint8_t*)data;
+    std::size_t pos = 0;
+
+#ifndef PUPPET_NO_SSE
+    for(; (PUPPET_SIZE - pos) >= 16; pos += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)&buf[pos]);
+        block = _mm_add_epi8(block, _mm_loadu_si128((const __m128i*)&delta_[pos]));
+        block = _mm_xor_si128(block, _mm_loadu_si128((const __m128i*)&mask_[pos]));
+        _mm_storeu_si128((__m128i*)&buf[pos], block);
+    }
+#endif
+
+    for(; pos < PUPPET_SIZE; ++pos)
+        buf[pos] = uint8_t((buf[pos] + delta_[pos]) ^ mask_[pos]);
 }
@@ -19,6 +19,7 @@
 #define PUPPET_H
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 #define PUPPET_SIZE 0x91
 #define PUPPET_SIZE_BOX (PUPPET_SIZE + 0x4)
@@ -51,6 +52,8 @@ private:
     char trainer_name_raw_[32];
     char puppet_nickname_raw_[32];
 
+    friend struct PuppetLayout;
+
 public:
     uint32_t trainer_id;
     uint32_t secret_id;
@@ -89,14 +92,34 @@ public:
     inline bool has_heart_mark() const {return (unknown_0x71[0] != 0);}
     inline void set_heart_mark(bool marked) {unknown_0x71[0] = marked ? 1 : 0;}
 
-    /* NOTE: these functions perform conversion to/from
-     * Shift-JIS internally. */
-    std::wstring trainer_name() const;
-    void set_trainer_name(const std::wstring& name);
+    /* NOTE: these functions take and return UTF-8
+     * and perform conversion to/from Shift-JIS internally. */
+    std::string trainer_name() const;
+    void set_trainer_name(std::string_view name);
+
+    std::string puppet_nickname() const;
+    void set_puppet_nickname(std::string_view name);
+};
+
+/* cipher applied to puppets stored in .DOD files.
+ * the keystream comes from EFile.bin and only depends on the byte position,
+ * so it is computed once up front and reused for every puppet */
+class PuppetCipher
+{
+private:
+    uint8_t mask_[PUPPET_SIZE];     /* 0xff where the byte is inverted, 0 otherwise */
+    uint8_t delta_[PUPPET_SIZE];    /* added on encryption, subtracted on decryption */
+
+public:
+    PuppetCipher();
+    PuppetCipher(const void *rand_data) { init(rand_data); }
+
+    /* rand_data is the contents of EFile.bin */
+    void init(const void *rand_data);
 
-    std::wstring puppet_nickname() const;
-    void set_puppet_nickname(const std::wstring& name);
-    void set_puppet_nickname(const std::string& name);
+    /* 'data' must be at least PUPPET_SIZE bytes */
+    void decrypt(void *data) const;
+    void encrypt(void *data) const;
 };
 
 #endif // PUPPET_H
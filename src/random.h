@@ -0,0 +1,245 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RANDOM_H
+#define RANDOM_H
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <initializer_list>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/* the standard library engines and distributions aren't required to produce the same
+ * results on every implementation (and they don't), so the same seed would give a different
+ * game depending on which compiler the randomizer was built with.
+ * everything in here is fully specified, so a seed always produces the same output.
+ *
+ * bump this whenever a change would make an existing seed produce different results.
+ * it is stored in share codes so we can warn about mismatches */
+#define RNG_VERSION 4
+
+/* xoshiro256** by David Blackman and Sebastiano Vigna, seeded via splitmix64.
+ * satisfies the UniformRandomBitGenerator requirements */
+class RandomEngine
+{
+private:
+    uint64_t s_[4];
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+    typedef uint64_t result_type;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~uint64_t(0); }
+
+    RandomEngine() { seed(0); }
+    explicit RandomEngine(uint64_t seed_value) { seed(seed_value); }
+
+    void seed(uint64_t seed_value)
+    {
+        for(auto& i : s_)
+        {
+            uint64_t z = (seed_value += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            i = z ^ (z >> 31);
+        }
+    }
+
+    result_type operator()()
+    {
+        uint64_t ret = rotl(s_[1] * 5, 7) * 9;
+        uint64_t t = s_[1] << 17;
+
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+
+        return ret;
+    }
+};
+
+/* unbiased random integer in [0, bound). bound must not be 0.
+ * uses Lemire's multiply-and-reject method for 32 bit bounds (which is everything we
+ * actually use), and a plain rejection loop otherwise */
+inline uint64_t random_below(RandomEngine& gen, uint64_t bound)
+{
+    assert(bound);
+
+    if(bound <= 0xffffffffull)
+    {
+        uint32_t range = (uint32_t)bound;
+        uint64_t m = (gen() >> 32) * range;
+        if((uint32_t)m < range)
+        {
+            uint32_t threshold = (0u - range) % range;
+            while((uint32_t)m < threshold)
+                m = (gen() >> 32) * range;
+        }
+
+        return m >> 32;
+    }
+
+    uint64_t threshold = (0 - bound) % bound;
+    uint64_t r;
+    do
+    {
+        r = gen();
+    } while(r < threshold);
+
+    return r % bound;
+}
+
+/* drop-in replacement for std::uniform_int_distribution, produces values in [a, b] */
+template<typename T>
+class UniformIntDist
+{
+private:
+    T a_, b_;
+
+public:
+    UniformIntDist(T a, T b) : a_(a), b_(b) { assert(a <= b); }
+
+    T operator()(RandomEngine& gen) const
+    {
+        uint64_t range = (uint64_t)((int64_t)b_ - (int64_t)a_);
+        if(range == ~uint64_t(0))
+            return (T)gen();
+
+        return (T)((int64_t)a_ + (int64_t)random_below(gen, range + 1));
+    }
+
+    T a() const { return a_; }
+    T b() const { return b_; }
+};
+
+/* drop-in replacement for std::bernoulli_distribution.
+ * the probability is converted to a 53 bit fixed point threshold, so p = 1.0 is always true */
+class BernoulliDist
+{
+private:
+    uint64_t threshold_;
+
+public:
+    explicit BernoulliDist(double p = 0.5)
+    {
+        if(p <= 0.0)
+            threshold_ = 0;
+        else if(p >= 1.0)
+            threshold_ = 1ull << 53;
+        else
+            threshold_ = (uint64_t)(p * 9007199254740992.0); /* 2^53 */
+    }
+
+    bool operator()(RandomEngine& gen) const
+    {
+        return (gen() >> 11) < threshold_;
+    }
+};
+
+/* 64 independent bernoulli trials at once, each bit of the result is set with probability p.
+ * p is rounded to 16 bits and the word is built bit-sliced: starting from the lowest set bit of p,
+ * each bit of p ORs (1) or ANDs (0) in a fresh random word, which halves the probability and adds
+ * that bit. costs one call to the engine per significant bit of p instead of one per trial */
+class BernoulliMask
+{
+private:
+    uint32_t p_;        /* 16 bit fixed point, 0x10000 = 1.0 */
+    unsigned int low_;  /* lowest set bit of p_ */
+
+public:
+    explicit BernoulliMask(double p = 0.5)
+    {
+        if(p <= 0.0)
+            p_ = 0;
+        else if(p >= 1.0)
+            p_ = 0x10000;
+        else
+            p_ = (uint32_t)(p * 65536.0 + 0.5);
+
+        low_ = 0;
+        while((low_ < 16) && !(p_ & (1u << low_)))
+            ++low_;
+    }
+
+    uint64_t operator()(RandomEngine& gen) const
+    {
+        if(p_ >= 0x10000)
+            return ~uint64_t(0);
+
+        uint64_t ret = 0;
+        for(unsigned int i = low_; i < 16; ++i)
+        {
+            uint64_t r = gen();
+            ret = ((p_ >> i) & 1) ? (ret | r) : (ret & r);
+        }
+
+        return ret;
+    }
+};
+
+/* drop-in replacement for std::discrete_distribution with integer weights.
+ * returns index i with probability weights[i] / sum(weights) */
+class DiscreteDist
+{
+private:
+    std::vector<uint64_t> cumulative_;
+
+public:
+    DiscreteDist(std::initializer_list<unsigned int> weights)
+    {
+        uint64_t total = 0;
+        for(auto i : weights)
+        {
+            total += i;
+            cumulative_.push_back(total);
+        }
+
+        assert(total);
+    }
+
+    int operator()(RandomEngine& gen) const
+    {
+        uint64_t r = random_below(gen, cumulative_.back());
+
+        int ret = 0;
+        while(r >= cumulative_[ret])
+            ++ret;
+
+        return ret;
+    }
+};
+
+/* Fisher-Yates shuffle, replacement for std::shuffle */
+template<typename It>
+void rand_shuffle(It first, It last, RandomEngine& gen)
+{
+    auto len = std::distance(first, last);
+    for(decltype(len) i = len - 1; i > 0; --i)
+    {
+        using std::swap;
+        swap(first[i], first[random_below(gen, (uint64_t)i + 1)]);
+    }
+}
+
+#endif // RANDOM_H
@@ -18,24 +18,33 @@
 /* Reader beware, insanity lies ahead! */
 
 #include "randomizer.h"
+#include "exptable.h"
+#include "statquota.h"
 #include "filesystem.h"
 #include "archive.h"
 #include "gamedata.h"
 #include "puppet.h"
 #include "endian.h"
 #include "textconvert.h"
+#include "parallel.h"
+#include "hash.h"
+#include "patch.h"
+#include "profile.h"
 #include <algorithm>
 #include <cmath>
 #include <algorithm>
 #include <cassert>
 #include <cwchar>
 #include <type_traits>
-#include <sstream>
 #include <utility>
 #include <map>
 
-static const int g_cost_exp_modifiers[] = {70, 85, 100, 115, 130};
-static const int g_cost_exp_modifiers_ynk[] = {85, 92, 100, 107, 115};
+/* past this much text the string pool is emptied before a run, see Randomizer::clear() */
+#define STRING_POOL_LIMIT (8 * 1024 * 1024)
+
+/* the archives randomize() modifies, and so the only ones a patch may name */
+static const char *g_patch_archives[] = {"gn_dat3.arc", "gn_dat5.arc", "gn_dat6.arc"};
+
 static const uint16_t g_sign_skills[] = {127, 179, 233, 273, 327, 375, 421, 474, 524, 566, 623, 680, 741, 782, 817};
 
 static inline bool is_sign_skill(unsigned int id)
@@ -47,8 +56,8 @@ static inline bool is_sign_skill(unsigned int id)
     return false;
 }
 
-template<typename T>
-void subtract_set(std::vector<T>& vec, const std::set<T>& s)
+template<typename T, typename Set>
+void subtract_set(std::vector<T>& vec, const Set& s)
 {
     auto it = vec.begin();
     while(it != vec.end())
@@ -62,36 +71,68 @@ void subtract_set(std::vector<T>& vec, const std::set<T>& s)
     }
 }
 
-template<typename T>
-void subtract_set(std::set<T>& s1, const std::set<T>& s2)
+template<std::size_t Bits>
+void subtract_set(IDBitset<Bits>& s1, const IDBitset<Bits>& s2)
+{
+    s1 -= s2;
+}
+
+/* IDSet only holds IDs below IDSet::capacity() */
+static inline bool is_oversized_id(long id)
+{
+    return (id < 0) || ((std::size_t)id >= IDSet::capacity());
+}
+
+/* returns true and sets id to the first ID in ids that doesn't fit */
+template<typename Container>
+static bool find_oversized_id(const Container& ids, long& id)
 {
-    for(auto i : s2)
-        s1.erase(i);
+    for(auto i : ids)
+    {
+        if(is_oversized_id((long)i))
+        {
+            id = (long)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static std::wstring oversized_id_error(const wchar_t *file, const wchar_t *what, long id)
+{
+    return std::wstring(file) + L" contains " + what + L" ID " + std::to_wstring(id) +
+           L", the randomizer only supports IDs below " + std::to_wstring(IDSet::capacity());
 }
 
 void Randomizer::export_locations(const std::wstring& filepath)
 {
     std::string out("\xEF\xBB\xBF"); /* UTF-8 BOM to make MS Notepad happy */
-    std::wstring temp;
+    std::vector<std::string_view> labels;
 
     for(const auto& it : loc_map_)
     {
         if(it.first >= puppet_names_.size())
             continue;
 
-        temp += puppet_names_[it.first];
-        temp += L":\r\n";
+        out += strings_.str(puppet_names_[it.first]);
+        out += ":\r\n";
 
-        for(auto& j : it.second)
+        /* the labels are kept in symbol order, list them alphabetically */
+        labels.clear();
+        for(auto j : it.second)
+            labels.push_back(strings_.str(j));
+        std::sort(labels.begin(), labels.end());
+
+        for(auto j : labels)
         {
-            temp += j;
-            temp += L"\r\n";
+            out += j;
+            out += "\r\n";
         }
 
-        temp += L"\r\n";
+        out += "\r\n";
     }
 
-    out += utf_narrow(temp);
     if(!write_file(filepath, out.c_str(), out.length()))
         error(std::wstring(L"Failed to write to file: ") + filepath + L"\nPlease make sure you have write permission");
 }
@@ -99,36 +140,40 @@ void Randomizer::export_locations(const std::wstring& filepath)
 void Randomizer::export_puppets(const std::wstring& filepath)
 {
     std::string out("\xEF\xBB\xBF"); /* UTF-8 BOM to make MS Notepad happy */
-    std::wstring temp;
 
-    for(const auto& it : puppets_)
+    for(const auto& puppet : puppets_)
     {
-        const PuppetData& puppet(it.second);
         for(auto index = 0; index < 4; ++index)
         {
             auto& style = puppet.styles[index];
             if(style.style_type == 0)
                 continue;
-            temp += style.style_string() + L' ' + puppet_names_.at(puppet.id) + L" (";
-            temp += element_string(style.element1);
+            out += style.style_string() + ' ';
+            out += strings_.str(puppet_names_.at(puppet.id));
+            out += " (";
+            out += element_string(style.element1);
             if(style.element2)
-                temp += L'/' + element_string(style.element2);
-            temp += L") " + std::to_wstring((puppet.cost * 10) + 80) + L" Cost\r\n";
-            temp += L"\tHP: " + std::to_wstring(style.base_stats[0]) + L"\r\n";
-            temp += L"\tFo.Atk: " + std::to_wstring(style.base_stats[1]) + L"\r\n";
-            temp += L"\tFo.Def: " + std::to_wstring(style.base_stats[2]) + L"\r\n";
-            temp += L"\tSp.Atk: " + std::to_wstring(style.base_stats[3]) + L"\r\n";
-            temp += L"\tSp.Def: " + std::to_wstring(style.base_stats[4]) + L"\r\n";
-            temp += L"\tSpeed: " + std::to_wstring(style.base_stats[5]) + L"\r\n\r\n";
-
-            temp += L"\tAbilities:\r\n";
+                out += '/' + element_string(style.element2);
+            out += ") " + std::to_string((puppet.cost * 10) + 80) + " Cost\r\n";
+            out += "\tHP: " + std::to_string(style.base_stats[0]) + "\r\n";
+            out += "\tFo.Atk: " + std::to_string(style.base_stats[1]) + "\r\n";
+            out += "\tFo.Def: " + std::to_string(style.base_stats[2]) + "\r\n";
+            out += "\tSp.Atk: " + std::to_string(style.base_stats[3]) + "\r\n";
+            out += "\tSp.Def: " + std::to_string(style.base_stats[4]) + "\r\n";
+            out += "\tSpeed: " + std::to_string(style.base_stats[5]) + "\r\n\r\n";
+
+            out += "\tAbilities:\r\n";
             for(auto i : style.abilities)
             {
                 if(i > 0)
-                    temp += L"\t\t" + ability_names_[i] + L"\r\n";
+                {
+                    out += "\t\t";
+                    out += strings_.str(ability_names_[i]);
+                    out += "\r\n";
+                }
             }
 
-            temp += L"\r\n\tSkills:\r\n";
+            out += "\r\n\tSkills:\r\n";
             std::multimap<int, uint16_t> skills;
             for(auto i : style.skillset)
             {
@@ -142,40 +187,38 @@ void Randomizer::export_puppets(const std::wstring& filepath)
             for(auto& i : skills)
             {
                 if(i.second > 0)
-                    temp += L"\t\tLvl " + std::to_wstring(i.first) + L": " + skill_names_[i.second] + L"\r\n";
-            }
-
-            temp += L"\r\n\tSkill Cards:\r\n";
-            for(unsigned int i = 0; i < 16; ++i)
-            {
-                for(unsigned int j = 0; j < 8; ++j)
                 {
-                    int item_id = 385 + (8 * i) + j;
-                    if(!items_.count(item_id) || !items_[item_id].is_valid())
-                        continue;
-
-                    if(style.skill_compat_table[i] & (1 << j))
-                    {
-                        auto card_num = (i * 8) + j + 1;
-                        if(is_ynk_ && (card_num >= 114)) // fix for sign skills in YnK
-                            card_num -= 8;
-                        temp += L"\t\t#" + std::to_wstring(card_num) + L' ';
-                        temp += skill_names_[items_[item_id].skill_id] + L"\r\n";
-                    }
+                    out += "\t\tLvl " + std::to_string(i.first) + ": ";
+                    out += strings_.str(skill_names_[i.second]);
+                    out += "\r\n";
                 }
             }
 
-            temp += L"\r\n\r\n";
+            out += "\r\n\tSkill Cards:\r\n";
+            style.skill_compat.for_each([&](unsigned int bit)
+            {
+                unsigned int item_id = SKILLCARD_FIRST_ITEM + bit;
+                if(!item_data(item_id).is_valid())
+                    return;
+
+                auto card_num = bit + 1;
+                if(is_ynk_ && (card_num >= 114)) // fix for sign skills in YnK
+                    card_num -= 8;
+                out += "\t\t#" + std::to_string(card_num) + ' ';
+                out += strings_.str(skill_names_[item_data(item_id).skill_id]);
+                out += "\r\n";
+            });
+
+            out += "\r\n\r\n";
         }
     }
 
-    out += utf_narrow(temp);
     write_file(filepath, out.c_str(), out.length());
 }
 
 bool Randomizer::export_compat(Archive& arc, const std::wstring& filepath)
 {
-    if(!rand_export_compat_)
+    if(!opts_.rand_export_compat)
         return true;
 
     auto compat = arc.get_file(is_ynk_ ? "doll/Compatibility.csv" : "doll/elements/Compatibility.csv");
@@ -192,40 +235,41 @@ bool Randomizer::export_compat(Archive& arc, const std::wstring& filepath)
         return false;
     }
 
-    CSVFile new_csv;
+    std::string table;
 
-    wchar_t *elements[] = { L"", L"", L"Void", L"Fire", L"Water", L"Nature", L"Earth", L"Steel", L"Wind", L"Electric", L"Light", L"Dark", L"Nether", L"Poison", L"Fighting", L"Illusion", L"Sound", L"Dream", L"Warped" };
-    wchar_t *short_elements[] = {L"", L"", L"Voi", L"Fir", L"Wtr", L"Ntr", L"Ear", L"Stl", L"Wnd", L"Ele", L"Lgt", L"Drk", L"Nth", L"Poi", L"Fgt", L"Ilu", L"Snd", L"Drm", L"Wrp"};
-    wchar_t *markers[] = { L"X", L"R", L" ", L" ", L"W" };
+    const char *elements[] = { "", "", "Void", "Fire", "Water", "Nature", "Earth", "Steel", "Wind", "Electric", "Light", "Dark", "Nether", "Poison", "Fighting", "Illusion", "Sound", "Dream", "Warped" };
+    const char *short_elements[] = {"", "", "Voi", "Fir", "Wtr", "Ntr", "Ear", "Stl", "Wnd", "Ele", "Lgt", "Drk", "Nth", "Poi", "Fgt", "Ilu", "Snd", "Drm", "Wrp"};
+    const char *markers[] = { "X", "R", " ", " ", "W" };
 
-    new_csv.data().emplace_back();
     for(auto i = 2; i < (is_ynk_ ? 19 : 18); ++i)
-        new_csv.back().push_back(short_elements[i]);
+    {
+        if(i > 2)
+            table += '|';
+        table += short_elements[i];
+    }
+    table += "\r\n";
 
     unsigned int dist_stats[5] = { 0 };
 
     for(std::size_t line = 2; line < csv.num_lines(); ++line) // skip descriptor and null element
     {
-        new_csv.data().emplace_back();
         for(std::size_t field = 2; field < csv.num_fields(); ++field) // skip descriptor and null element
         {
-            auto val = std::stoul(csv[line][field]);
-            if(val >= 5)
+            auto val = parse_long(csv[line][field]);
+            if((val < 0) || (val >= 5))
             {
                 error(L"Error parsing compatibility.csv");
                 return false;
             }
-            new_csv.back().push_back(L" " + std::wstring(markers[val]) + L" ");
+            table += " " + std::string(markers[val]) + " |";
 
             ++dist_stats[val];
         }
-        new_csv.back().push_back(elements[line]);
+        table += elements[line];
+        table += "\r\n";
     }
 
-    auto out = new_csv.to_string();
-    for(auto& i : out)
-        if(i == ',')
-            i = '|';
+    auto out = utf8_to_sjis(table);
 
     out += "\r\nX = immune, R = not effective, blank = neutral, W = super effective.\r\nrow->column\r\n"
            "\r\nImmunities: " + std::to_string(dist_stats[0]) + "\r\nResistances: " + std::to_string(dist_stats[1]) +
@@ -254,7 +298,16 @@ void Randomizer::clear()
     normal_stats_.clear();
     evolved_stats_.clear();
     old_costs_.clear();
-    location_names_.clear();
+    location_counts_.clear();
+
+    /* the cached stage outputs hold symbols, so the pool can only be emptied along with them.
+     * names are the same every run, only new location labels add to it */
+    if(strings_.bytes() > STRING_POOL_LIMIT)
+    {
+        strings_.clear();
+        for(auto& i : stage_cache_)
+            i.valid = false;
+    }
 }
 
 bool Randomizer::open_archive(Archive& arc, const std::wstring& path)
@@ -272,25 +325,285 @@ bool Randomizer::open_archive(Archive& arc, const std::wstring& path)
     return true;
 }
 
-bool Randomizer::save_archive(Archive & arc, const std::wstring & path)
+bool Randomizer::open_archive(Archive& arc, std::future<Archive>& pending, const std::wstring& path)
+{
+    try
+    {
+        arc = pending.get();
+    }
+    catch(const ArcError& ex)
+    {
+        error(L"Failed to open file: " + path + L"\r\n" + utf_widen(ex.what()));
+        return false;
+    }
+
+    return true;
+}
+
+/* archives come from the preloaded buffers if we have them, otherwise from the game folder */
+std::future<Archive> Randomizer::open_archive_async(const std::wstring& dir, const std::wstring& name) const
 {
-    if(!arc.save(path))
+    if(buffers_ == nullptr)
+        return Archive::open_async(dir + L"/dat/" + name);
+
+    auto it = buffers_->find(name);
+    ArchiveBuffer buf = (it != buffers_->end()) ? it->second : ArchiveBuffer{nullptr, 0};
+
+    return std::async(std::launch::deferred, [buf]()
     {
-        error(std::wstring(L"Could not write to file: ") + path + L"\r\nPlease make sure you have write permission to the game folder.");
+        if(buf.data == nullptr)
+            throw ArcError("File not found.");
+
+        Archive arc;
+        arc.open(buf.data, buf.size);
+        return arc;
+    });
+}
+
+bool Randomizer::commit_archives(ArchiveWriter& writer)
+{
+    PROFILE_SCOPE("save_archive");
+
+    std::wstring failed_path;
+
+    if(!writer.commit(failed_path))
+    {
+        error(std::wstring(L"Could not write to file: ") + failed_path + L"\r\nPlease make sure you have write permission to the game folder.");
         return false;
     }
 
     return true;
 }
 
+uint64_t Randomizer::stage_key(RandomizerStage stage, uint64_t input_hash) const
+{
+    Hasher h;
+    h.add(stage).add(seed_).add(RNG_VERSION).add(is_ynk_).add(input_hash);
+
+    /* everything the stage reads, other than what it gets from upstream stages */
+    switch(stage)
+    {
+    case STAGE_PARSE:
+        h.add(opts_.rand_healthy).add(opts_.rand_skillcards);
+        break;
+
+    case STAGE_SKILLS:
+        h.add(stage_keys_[STAGE_PARSE]);
+        h.add(rand_skills_).add(opts_.rand_skill_element).add(opts_.rand_skill_power).add(opts_.rand_skill_acc);
+        h.add(opts_.rand_skill_sp).add(opts_.rand_skill_prio).add(opts_.rand_skill_type);
+        break;
+
+    case STAGE_PUPPETS:
+        h.add(stage_keys_[STAGE_PARSE]).add(stage_keys_[STAGE_SKILLS]);
+        h.add(rand_puppets_).add(opts_.rand_skillsets).add(opts_.rand_stats).add(opts_.rand_types).add(opts_.rand_abilities);
+        h.add(opts_.rand_cost).add(opts_.rand_quota).add(opts_.stat_quota).add(opts_.quota_shape).add(opts_.rand_true_rand_stats);
+        h.add(opts_.rand_stat_scaling).add(opts_.stat_ratio).add(opts_.rand_prefer_same_type).add(opts_.rand_true_rand_skills);
+        h.add(opts_.rand_starting_move);
+        break;
+
+    case STAGE_COMPAT:
+        h.add(opts_.rand_compat);
+        break;
+
+    case STAGE_NAMES:
+        break;
+
+    case STAGE_TRAINERS:
+        h.add(stage_keys_[STAGE_PARSE]).add(stage_keys_[STAGE_SKILLS]).add(stage_keys_[STAGE_PUPPETS]).add(stage_keys_[STAGE_NAMES]);
+        h.add(opts_.rand_trainers).add(opts_.rand_full_party).add(opts_.level_mod).add(opts_.rand_cost).add(opts_.rand_trainer_ai);
+        h.add(opts_.rand_trainer_max_ivs).add(opts_.rand_trainer_max_evs).add(opts_.rand_costumes).add(opts_.rand_evolved_trainers);
+        h.add(opts_.rand_strict_trainers).add(opts_.rand_trainer_sc_shuffle).add(opts_.trainer_item_chance).add(opts_.trainer_sc_chance);
+        break;
+
+    case STAGE_MAP_EVENTS:
+        h.add(opts_.rand_blind_trainers);
+        break;
+
+    case STAGE_WILD:
+        h.add(stage_keys_[STAGE_PARSE]).add(stage_keys_[STAGE_PUPPETS]);
+        h.add(opts_.rand_encounters).add(opts_.rand_export_locations).add(opts_.level_mod);
+        h.add(opts_.rand_bike_everywhere).add(opts_.rand_gap_map_everywhere);
+        break;
+
+    default:
+        assert(false);
+        break;
+    }
+
+    return h.value();
+}
+
+/* snapshot the members written by a stage.
+ * the returned function copies the snapshot back into the randomizer */
+std::function<void()> Randomizer::save_stage_outputs(RandomizerStage stage)
+{
+    switch(stage)
+    {
+    case STAGE_PARSE:
+        return [this, puppets = puppets_, items = items_, valid_puppet_ids = valid_puppet_ids_, puppet_id_pool = puppet_id_pool_,
+                skill_names = skill_names_, ability_names = ability_names_, valid_skills = valid_skills_,
+                valid_abilities = valid_abilities_, skillcard_ids = skillcard_ids_, held_item_ids = held_item_ids_,
+                normal_stats = normal_stats_, evolved_stats = evolved_stats_]()
+        {
+            puppets_ = puppets;
+            items_ = items;
+            valid_puppet_ids_ = valid_puppet_ids;
+            puppet_id_pool_ = puppet_id_pool;
+            skill_names_ = skill_names;
+            ability_names_ = ability_names;
+            valid_skills_ = valid_skills;
+            valid_abilities_ = valid_abilities;
+            skillcard_ids_ = skillcard_ids;
+            held_item_ids_ = held_item_ids;
+            normal_stats_ = normal_stats;
+            evolved_stats_ = evolved_stats;
+        };
+
+    case STAGE_SKILLS:
+        return [this, skills = skills_]() { skills_ = skills; };
+
+    case STAGE_PUPPETS:
+        return [this, puppets = puppets_, old_costs = old_costs_, normal_stats = normal_stats_, evolved_stats = evolved_stats_]()
+        {
+            puppets_ = puppets;
+            old_costs_ = old_costs;
+            normal_stats_ = normal_stats;
+            evolved_stats_ = evolved_stats;
+        };
+
+    case STAGE_NAMES:
+        return [this, puppet_names = puppet_names_]() { puppet_names_ = puppet_names; };
+
+    case STAGE_WILD:
+        return [this, loc_map = loc_map_, location_counts = location_counts_, puppet_id_pool = puppet_id_pool_]()
+        {
+            loc_map_ = loc_map;
+            location_counts_ = location_counts;
+            puppet_id_pool_ = puppet_id_pool;
+        };
+
+    default: /* the remaining stages only modify the archive */
+        return []() {};
+    }
+}
+
+/* run a stage, or replay its cached output if nothing it depends on has changed.
+ * input_hash identifies the files the stage reads, it's only used when caching() */
+bool Randomizer::run_stage(RandomizerStage stage, Archive& archive, uint64_t input_hash, const std::function<bool()>& func)
+{
+    bool use_cache = caching();
+    uint64_t key = use_cache ? stage_key(stage, input_hash) : 0;
+    stage_keys_[stage] = key;
+
+    StageOutput& cache = stage_cache_[stage];
+
+    if(use_cache && cache.valid && (cache.key == key))
+    {
+        if(!archive.repack_files(cache.journal))
+        {
+            error(L"Error repacking cached files");
+            return false;
+        }
+
+        cache.restore();
+        return true;
+    }
+
+    cache.valid = false;
+    cache.journal.clear();
+    cache.restore = nullptr;
+
+    /* every stage gets its own stream of random numbers, so changing the
+     * options of one stage doesn't change the results of the stages after it */
+    gen_.seed(Hasher().add(seed_).add(stage).value());
+
+    /* the journal is needed to replay the stage later, or to build a patch from it */
+    archive.set_journal((use_cache || opts_.write_patch) ? &cache.journal : nullptr);
+    bool ret = func();
+    archive.set_journal(nullptr);
+
+    if(!ret || !use_cache)
+        return ret;
+
+    cache.key = key;
+    cache.restore = save_stage_outputs(stage);
+    cache.valid = true;
+
+    return true;
+}
+
+/* add the final version of every file the given stages repacked to the patch */
+void Randomizer::add_patch_files(PatchTarget& target, const Archive& archive, RandomizerStage first, RandomizerStage last) const
+{
+    for(int stage = first; stage <= last; ++stage)
+    {
+        for(const auto& file : stage_cache_[stage].journal)
+        {
+            int index = file.file_index();
+            target.add_file(archive.get_path(index) + archive.get_filename(index), file.data(), file.size(), true);
+        }
+    }
+}
+
+bool Randomizer::apply_patch(const std::wstring& dir, const std::wstring& filepath)
+{
+    Patch patch;
+    ArchiveWriter writer;
+
+    try
+    {
+        patch.open(filepath);
+    }
+    catch(const PatchError& ex)
+    {
+        error(L"Failed to open patch: " + filepath + L"\r\n" + utf_widen(ex.what()));
+        return false;
+    }
+
+    /* the names come from the patch file, don't let it point anywhere else */
+    for(const auto& target : patch.targets())
+    {
+        if(std::find(std::begin(g_patch_archives), std::end(g_patch_archives), target.archive) == std::end(g_patch_archives))
+        {
+            error(L"Failed to open patch: " + filepath + L"\r\nUnexpected archive name: " + utf_widen(target.archive));
+            return false;
+        }
+    }
+
+    for(const auto& target : patch.targets())
+    {
+        Archive archive;
+        std::wstring path = dir + L"/dat/" + utf_widen(target.archive);
+
+        if(!open_archive(archive, path))
+            return false;
+
+        try
+        {
+            target.apply(archive);
+        }
+        catch(const PatchError& ex)
+        {
+            error(L"Failed to patch file: " + path + L"\r\n" + utf_widen(ex.what()));
+            return false;
+        }
+
+        writer.write(std::move(archive), path);
+    }
+
+    return commit_archives(writer);
+}
+
 void Randomizer::set_progress_bar(int percent)
 {
-    gui_->set_progress_bar(percent);
+    if(gui_ != nullptr)
+        gui_->set_progress_bar(percent);
 }
 
 void Randomizer::increment_progress_bar()
 {
-    gui_->increment_progress_bar();
+    if(gui_ != nullptr)
+        gui_->increment_progress_bar();
 }
 
 /* detect valid puppet/skill/etc IDs from the game data.
@@ -298,6 +611,8 @@ void Randomizer::increment_progress_bar()
  * for any version of the game. */
 bool Randomizer::parse_puppets(Archive& archive)
 {
+    PROFILE_SCOPE("parse_puppets");
+
     ArcFile file;
     if(!(file = archive.get_file("doll/dolldata.dbs")))
     {
@@ -305,21 +620,76 @@ bool Randomizer::parse_puppets(Archive& archive)
         return false;
     }
 
-    const char *buf = file.data();
+    PuppetTable table;
+    table.decode(file.data(), file.size());
+
+    /* modded data may use IDs we can't store, catch them here rather than part way through randomizing */
+    long bad_id;
+    for(std::size_t id = 0; id < table.size(); ++id)
+    {
+        if((table.style_type[id * 4] != 0) && find_oversized_id(table.base_skills[id], bad_id))
+        {
+            error(oversized_id_error(L"dolldata.dbs", L"a skill", bad_id));
+            return false;
+        }
+    }
+
+    for(std::size_t slot = 0; slot < table.num_styles(); ++slot)
+    {
+        if((table.style_type[slot] == 0) || (table.style_type[slot & ~(std::size_t)3] == 0))
+            continue;
+
+        if(is_oversized_id(table.lv100_skill[slot]))
+            bad_id = table.lv100_skill[slot];
+        else if(!find_oversized_id(table.style_skills[slot], bad_id) && !find_oversized_id(table.lv70_skills[slot], bad_id))
+            bad_id = -1;
+
+        if(bad_id >= 0)
+        {
+            error(oversized_id_error(L"dolldata.dbs", L"a skill", bad_id));
+            return false;
+        }
+
+        if(find_oversized_id(table.abilities[slot], bad_id))
+        {
+            error(oversized_id_error(L"dolldata.dbs", L"an ability", bad_id));
+            return false;
+        }
+    }
 
     /* there's a lot of unimplemented stuff floating around the files,
-     * so find all skills which are actually used by puppets */
-    for(unsigned int pos = 0; pos < file.size(); pos += PUPPET_DATA_SIZE)
+     * so find all skills which are actually used by puppets.
+     * a record whose first style is empty is not a real puppet */
+    for(std::size_t id = 0; id < table.size(); ++id)
     {
-        PuppetData puppet(&buf[pos]);
-        puppet.id = (uint16_t)(pos / PUPPET_DATA_SIZE);
-        if(puppet.styles[0].style_type == 0) /* not a real puppet */
+        if(table.style_type[id * 4] == 0)
             continue;
 
-        valid_puppet_ids_.push_back(puppet.id);
+        valid_puppet_ids_.push_back((unsigned int)id);
+        for(auto i : table.base_skills[id])
+            valid_skills_.insert(i);
+    }
 
-        for(auto i : puppet.base_skills)
+    for(std::size_t slot = 0; slot < table.num_styles(); ++slot)
+    {
+        if((table.style_type[slot] == 0) || (table.style_type[slot & ~(std::size_t)3] == 0))
+            continue;
+
+        valid_skills_.insert(table.lv100_skill[slot]);
+        for(auto i : table.style_skills[slot])
             valid_skills_.insert(i);
+        for(auto i : table.lv70_skills[slot])
+            valid_skills_.insert(i);
+        for(auto i : table.abilities[slot])
+            valid_abilities_.insert(i);
+
+        auto& stats = (table.style_type[slot] == STYLE_NORMAL) ? normal_stats_ : evolved_stats_;
+        stats.insert(stats.end(), table.base_stats[slot].begin(), table.base_stats[slot].end());
+    }
+
+    for(auto id : valid_puppet_ids_)
+    {
+        PuppetData puppet(table.get(id));
 
         for(auto& style : puppet.styles)
         {
@@ -328,50 +698,30 @@ bool Randomizer::parse_puppets(Archive& archive)
 
             for(auto i = 0; i < 4; ++i)
                 style.skillset.insert(puppet.styles[0].style_skills[i]);
-
-            valid_skills_.insert(style.lv100_skill);
             style.skillset.insert(style.lv100_skill);
             for(auto i : style.style_skills)
-            {
-                valid_skills_.insert(i);
                 style.skillset.insert(i);
-            }
-
             for(auto i : style.lv70_skills)
-            {
-                valid_skills_.insert(i);
                 style.skillset.insert(i);
-            }
-
             for(auto i : puppet.base_skills)
                 style.skillset.insert(i);
-
-            for(auto i : style.abilities)
-                valid_abilities_.insert(i);
-
-            for(auto i : style.base_stats)
-            {
-                if(style.style_type == STYLE_NORMAL)
-                    normal_stats_.push_back(i);
-                else
-                    evolved_stats_.push_back(i);
-            }
-
             style.skillset.erase(0);
         }
 
-        puppets_[puppet.id] = std::move(puppet);
+        puppets_.insert(puppet.id, std::move(puppet));
     }
 
     valid_skills_.erase(0);
     valid_abilities_.erase(0);
 
-    if(rand_healthy_)
+    if(opts_.rand_healthy)
         valid_abilities_.erase(313); /* remove frail health from the pool */
 
-    std::shuffle(normal_stats_.begin(), normal_stats_.end(), gen_);
-    std::shuffle(evolved_stats_.begin(), evolved_stats_.end(), gen_);
-    puppet_id_pool_.assign(valid_puppet_ids_, gen_);
+    rand_shuffle(normal_stats_.begin(), normal_stats_.end(), gen_);
+    rand_shuffle(evolved_stats_.begin(), evolved_stats_.end(), gen_);
+    puppet_id_pool_.assign(valid_puppet_ids_);
+
+    PROFILE_ADD(PROFILE_ENTRIES, puppets_.size());
 
     return true;
 }
@@ -379,6 +729,8 @@ bool Randomizer::parse_puppets(Archive& archive)
 /* detect valid item IDs and skillcards from the game data */
 bool Randomizer::parse_items(Archive& archive)
 {
+    PROFILE_SCOPE("parse_items");
+
     ArcFile file;
     if(!(file = archive.get_file("item/ItemData.csv")))
     {
@@ -387,67 +739,91 @@ bool Randomizer::parse_items(Archive& archive)
     }
 
     CSVFile csv;
-    if(!csv.parse(file.data(), file.size()) || (csv.num_fields() < 10))
+    ItemTable items;
+    if(!csv.parse(file.data(), file.size()) || !items.parse(csv, is_ynk_))
     {
         error(L"Error parsing ItemData.csv");
         return false;
     }
 
-    if(rand_skillcards_)
+    /* only implemented items end up in an IDSet, see parse_puppets() for why this is checked up front */
+    for(std::size_t line = 0; line < items.size(); ++line)
     {
-        auto skill_pool = valid_skills_;
-        try
+        if(items.type[line] >= 255)
+            continue;
+
+        if(is_oversized_id(items.id[line]))
         {
-            for(auto& it : csv.data())
-            {
-                if((it[3] == L"4") && (it[9] != L"0"))
-                    skill_pool.insert((uint16_t)std::stoul(it[9]));
-            }
+            error(oversized_id_error(L"ItemData.csv", L"an item", items.id[line]));
+            return false;
         }
-        catch(const std::exception&)
+
+        if(is_oversized_id(items.skill_id[line]))
         {
-            error(L"Error parsing ItemData.csv");
+            error(oversized_id_error(L"ItemData.csv", L"a skill", items.skill_id[line]));
             return false;
         }
+    }
+
+    if(opts_.rand_skillcards)
+    {
+        auto skill_pool = valid_skills_;
+        for(std::size_t line = 0; line < items.size(); ++line)
+        {
+            if((items.type[line] == 4) && (items.skill_id[line] != 0))
+                skill_pool.insert((uint16_t)items.skill_id[line]);
+        }
 
         skill_pool.erase(0);
-        if(rand_skillcards_ > 1)
+        if(opts_.rand_skillcards > 1)
             for(auto i : g_sign_skills)
                 skill_pool.erase(i);
 
         IDVec skills(skill_pool.begin(), skill_pool.end());
-        std::shuffle(skills.begin(), skills.end(), gen_);
+        rand_shuffle(skills.begin(), skills.end(), gen_);
 
-        for(auto& it : csv.data())
+        bool changed = false;
+        for(std::size_t line = 0; line < items.size(); ++line)
         {
-            if((it[3] == L"4") && (it[9] != L"0") && ((rand_skillcards_ < 2) || !is_sign_skill(std::stoul(it[9]))))
+            if((items.type[line] == 4) && (items.skill_id[line] != 0) && ((opts_.rand_skillcards < 2) || !is_sign_skill(items.skill_id[line])))
             {
                 assert(!skills.empty());
                 if(skills.empty())
                     continue;
-                it[9] = std::to_wstring(skills.back());
+                items.skill_id[line] = skills.back();
+                csv.set_field(line, 9, std::to_string(skills.back()));
                 skills.pop_back();
+                changed = true;
             }
         }
 
-        std::string temp = csv.to_string();
-        archive.repack_file("item/ItemData.csv", temp.c_str(), temp.length());
+        if(changed)
+        {
+            std::string temp = csv.to_string();
+            archive.repack_file("item/ItemData.csv", temp.c_str(), temp.length());
+        }
     }
 
+    /* usable items first, as a plain pass over the type column */
+    std::vector<uint8_t> usable(items.size());
+    for(std::size_t line = 0; line < items.size(); ++line)
+        usable[line] = (items.type[line] < 255);
+
     /* there are some items that otherwise appear to be real items but aren't actually implemented in-game
      * they follow the naming convention of the other unimplemented items i.e. "ItemXXX", so we filter those out too */
-    for(const auto& it : csv.data())
+    for(std::size_t line = 0; line < items.size(); ++line)
     {
-        ItemData item;
-        if(!item.parse(it, is_ynk_) || (item.name.find(L"Item") != std::wstring::npos) || !item.is_valid())
+        if(!usable[line] || (items.name[line].find("Item") != std::string_view::npos))
             continue;
-        if((item.type == 4) && (item.skill_id != 0))
-            skillcard_ids_.insert((uint16_t)item.id);
-        else if(item.held)
-            held_item_ids_.insert((uint16_t)item.id);
-        items_[item.id] = item;
+        if((items.type[line] == 4) && (items.skill_id[line] != 0))
+            skillcard_ids_.insert((uint16_t)items.id[line]);
+        else if(items.flags[line] & ITEM_HELD)
+            held_item_ids_.insert((uint16_t)items.id[line]);
+        items_.insert(items.id[line], items.row(line));
     }
 
+    PROFILE_ADD(PROFILE_ENTRIES, items_.size());
+
     return true;
 }
 
@@ -472,8 +848,8 @@ bool Randomizer::parse_skill_names(Archive& archive)
     {
         try
         {
-            for(auto& it : csv.data())
-                skill_names_[std::stol(it[0])] = it[1];
+            for(auto it : csv)
+                skill_names_[parse_long(it[0])] = strings_.intern(it[1]);
         }
         catch(const std::exception&)
         {
@@ -484,8 +860,8 @@ bool Randomizer::parse_skill_names(Archive& archive)
     else
     {
         int index = 0;
-        for(auto& it : csv.data())
-            skill_names_[index++] = it[0];
+        for(auto it : csv)
+            skill_names_[index++] = strings_.intern(it[0]);
     }
 
     return true;
@@ -510,8 +886,8 @@ bool Randomizer::parse_ability_names(Archive& archive)
 
     try
     {
-        for(auto& it : csv.data())
-            ability_names_[std::stol(it[0])] = it[1];
+        for(auto it : csv)
+            ability_names_[parse_long(it[0])] = strings_.intern(it[1]);
     }
     catch(const std::exception&)
     {
@@ -524,6 +900,8 @@ bool Randomizer::parse_ability_names(Archive& archive)
 
 bool Randomizer::randomize_puppets(Archive& archive)
 {
+    PROFILE_SCOPE("randomize_puppets");
+
     if(!rand_puppets_)
         return true;
 
@@ -533,437 +911,447 @@ bool Randomizer::randomize_puppets(Archive& archive)
         error(L"Error unpacking dolldata.dbs from game data");
         return false;
     }
-    IDSet valid_base_skills, valid_normal_skills, valid_evolved_skills, valid_lv70_skills, valid_lv100_skills;
-    IDVec ability_deck(valid_abilities_.begin(), valid_abilities_.end());
-    std::bernoulli_distribution chance25(0.25); /* 25% chance */
-    std::bernoulli_distribution chance35(0.35); /* 35% chance */
-    std::bernoulli_distribution chance60(0.6);  /* 60% chance */
-    std::bernoulli_distribution chance75(0.75); /* 75% chance */
-    std::bernoulli_distribution chance90(0.9);  /* 90% chance */
-    std::uniform_int_distribution<unsigned int> element(1, is_ynk_ ? ELEMENT_WARPED : ELEMENT_SOUND);
-    std::uniform_int_distribution<unsigned int> pick_stat(0, 5);
-    std::uniform_int_distribution<unsigned int> gen_stat(0, 0xff);
-    std::uniform_int_distribution<unsigned int> gen_quota(0, 64);
-    std::uniform_int_distribution<unsigned int> gen_cost(0, 4);
-
-    /* stat distribution statistics */
-#ifndef NDEBUG
-    unsigned int a[256] = {0};
-    int64_t accum = 0;
-    int amin = 0, amax = 0;
-#endif
+    SkillPools pools;
+
+    PuppetTable table;
+    table.decode(file.data(), file.size());
 
     /* initialize skill pools for randomization.
      * skill pools are populated from skills possesed by puppets found in the game data.
      * this eliminates a dependency on pre-built tables, and should work for any version
      * of the game. */
-    for(const auto& it : puppets_)
+    for(auto id : valid_puppet_ids_)
+    {
+        for(auto i : table.base_skills[id])
+            pools.base.insert(i);
+    }
+
+    for(std::size_t slot = 0; slot < table.num_styles(); ++slot)
     {
-        const PuppetData& puppet(it.second);
+        if((table.style_type[slot] == 0) || (table.style_type[slot & ~(std::size_t)3] == 0))
+            continue;
+
+        pools.lv100.insert(table.lv100_skill[slot]);
 
-        for(auto i : puppet.base_skills)
-            valid_base_skills.insert(i);
+        auto& pool = (table.style_type[slot] == STYLE_NORMAL) ? pools.normal : pools.evolved;
+        for(auto i : table.style_skills[slot])
+            pool.insert(i);
+
+        for(auto i : table.lv70_skills[slot])
+            pools.lv70.insert(i);
+    }
+
+    pools.base.erase(0);
+    pools.normal.erase(0);
+    pools.evolved.erase(0);
+    pools.lv70.erase(0);
+    pools.lv100.erase(0);
+
+    for(auto i : skillcard_ids_)
+    {
+        if((i < SKILLCARD_FIRST_ITEM) || (i >= (SKILLCARD_FIRST_ITEM + SKILL_COMPAT_BITS)))
+            continue;
+
+        unsigned int bit = i - SKILLCARD_FIRST_ITEM;
+        auto e = skill_data(item_data(i).skill_id).element;
+        pools.cards.set(bit);
+        if(e < ELEMENT_MAX)
+            pools.card_elements[e].set(bit);
+    }
+
+    /* deterministic pre-pass. everything shared between puppets is handed out here, in puppet order,
+     * so the per-puppet work below is independent and can run on any thread in any order.
+     * each puppet gets its own RNG stream and a fixed slice of the shuffled stat decks */
+    std::vector<PuppetData*> puppets;
+    std::vector<RandomEngine::result_type> seeds;
+    std::vector<std::size_t> normal_pos, evolved_pos;
+    std::size_t normal_cursor = normal_stats_.size();
+    std::size_t evolved_cursor = evolved_stats_.size();
+    bool use_stat_decks = opts_.rand_stats && !opts_.rand_quota && !opts_.rand_true_rand_stats && !opts_.rand_stat_scaling;
+
+    puppets.reserve(puppets_.size());
+    for(auto& puppet : puppets_)
+    {
+        puppets.push_back(&puppet);
+        seeds.push_back(gen_());
+        normal_pos.push_back(normal_cursor);
+        evolved_pos.push_back(evolved_cursor);
+
+        /* we'll need to adjust the exp for trainer puppets, so save the original costs */
+        if(opts_.rand_cost)
+            old_costs_[puppet.id] = puppet.cost;
+
+        if(!use_stat_decks)
+            continue;
 
         for(const auto& style : puppet.styles)
         {
             if(style.style_type == 0)
                 continue;
 
-            valid_lv100_skills.insert(style.lv100_skill);
-
-            if(style.style_type == STYLE_NORMAL)
-            {
-                for(auto i : style.style_skills)
-                    valid_normal_skills.insert(i);
-            }
-            else
-            {
-                for(auto i : style.style_skills)
-                    valid_evolved_skills.insert(i);
-            }
-
-            for(auto i : style.lv70_skills)
-                valid_lv70_skills.insert(i);
+            std::size_t& cursor = (style.style_type == STYLE_NORMAL) ? normal_cursor : evolved_cursor;
+            cursor -= std::min<std::size_t>(cursor, 6);
         }
     }
 
-    valid_base_skills.erase(0);
-    valid_normal_skills.erase(0);
-    valid_evolved_skills.erase(0);
-    valid_lv70_skills.erase(0);
-    valid_lv100_skills.erase(0);
-
-    int step = puppets_.size() / 25;
-    int count = 0;
+    /* the stats handed out above are no longer in the decks */
+    normal_stats_.resize(normal_cursor);
+    evolved_stats_.resize(evolved_cursor);
 
     /* begin puppet randomization */
-    for(auto& it : puppets_)
+    std::size_t steps = 0;
+    parallel_for(puppets.size(), [&](std::size_t i)
     {
-        PuppetData& puppet(it.second);
+        PuppetData& puppet(*puppets[i]);
+        RandomEngine gen(seeds[i]);
+
+        randomize_puppet(puppet, pools, gen, normal_pos[i], evolved_pos[i]);
 
+        /* every puppet has its own record in the table, so no locking is needed */
+        table.set(puppet);
+    },
+    [&](std::size_t done)
+    {
         /* update the progress bar */
-        if(++count > step)
-        {
+        for(; steps < (done * 25) / puppets.size(); ++steps)
             increment_progress_bar();
-            count = 0;
-        }
+    });
+
+    PROFILE_ADD(PROFILE_ENTRIES, puppets.size());
 
-        /* pre-randomize typings */
-        if(rand_types_)
+    /* write back only the records that actually changed */
+    if(table.num_dirty() == 0)
+        return true;
+    table.encode(file.data());
+
+    /* replace the puppet data file in the archive with our modified version */
+    if(!archive.repack_file(file))
+    {
+        error(L"Error repacking dolldata.dbs");
+        return false;
+    }
+
+    return true;
+}
+
+/* randomizes a single puppet. this only reads shared state, so it may run on any thread.
+ * normal_pos and evolved_pos mark the end of this puppet's slice of normal_stats_/evolved_stats_.
+ * stats are taken from the back of the slice, same as drawing from a deck */
+void Randomizer::randomize_puppet(PuppetData& puppet, const SkillPools& pools, RandomEngine& gen, std::size_t normal_pos, std::size_t evolved_pos) const
+{
+    BernoulliDist chance60(0.6);  /* 60% chance */
+    BernoulliDist chance75(0.75); /* 75% chance */
+    BernoulliDist chance90(0.9);  /* 90% chance */
+    BernoulliMask compat25(0.25), compat35(0.35), compat60(0.6); /* skill card chances, a whole word of cards at a time */
+    UniformIntDist<unsigned int> element(1, is_ynk_ ? ELEMENT_WARPED : ELEMENT_SOUND);
+    UniformIntDist<unsigned int> gen_stat(0, 0xff);
+    UniformIntDist<unsigned int> gen_cost(0, 4);
+    IDVec ability_deck(valid_abilities_.begin(), valid_abilities_.end());
+
+    /* pre-randomize typings */
+    if(opts_.rand_types)
+    {
+        for(auto& style : puppet.styles)
         {
-            for(auto& style : puppet.styles)
+            style.element1 = (uint8_t)element(gen);
+            if(!chance75(gen))
+                style.element2 = 0;
+            else
             {
-                style.element1 = (uint8_t)element(gen_);
-                if(!chance75(gen_))
+                style.element2 = (uint8_t)element(gen);
+                if(style.element1 == style.element2)
                     style.element2 = 0;
-                else
-                {
-                    style.element2 = (uint8_t)element(gen_);
-                    if(style.element1 == style.element2)
-                        style.element2 = 0;
-                }
             }
         }
+    }
 
-        /* randomize cost */
-        if(rand_cost_)
-        {
-            /* we'll need to adjust the exp for trainer puppets, so save the original costs */
-            old_costs_[puppet.id] = puppet.cost;
+    /* randomize cost (the original costs are saved by randomize_puppets()) */
+    if(opts_.rand_cost)
+    {
+        if(opts_.rand_cost > 1)
+            puppet.cost = 4;
+        else
+            puppet.cost = (uint8_t)gen_cost(gen);
+    }
 
-            if(rand_cost_ > 1)
-                puppet.cost = 4;
-            else
-                puppet.cost = (uint8_t)gen_cost(gen_);
-        }
+    /* randomize move sets */
+    if(opts_.rand_skillsets)
+    {
+        SkillDeck skill_deck;
+        if(opts_.rand_true_rand_skills)
+            assign_skill_deck(skill_deck, valid_skills_, gen);
+        else
+            assign_skill_deck(skill_deck, pools.base, gen);
 
-        /* randomize move sets */
-        if(rand_skillsets_)
+        /* moves shared by all styles of a particular puppet */
+        for(auto& i : puppet.base_skills)
         {
-            IDDeck skill_deck;
-            if(rand_true_rand_skills_)
-                skill_deck.assign(valid_skills_, gen_);
-            else
-                skill_deck.assign(valid_base_skills, gen_);
-
-            /* moves shared by all styles of a particular puppet */
-            for(auto& i : puppet.base_skills)
+            if(i != 0)
             {
-                if(i != 0)
+                if(opts_.rand_prefer_same_type && chance60(gen))
                 {
-                    if(rand_prefer_same_type_ && chance60(gen_))
-                    {
-                        auto val = get_stab_skill(skill_deck, puppet.styles[0].element1, puppet.styles[0].element2);
-                        i = (val) ? *val : skill_deck.draw(i); // if we find a stab skill, use it. otherwise draw a random skill. keep original if deck is empty.
-                    }
-                    else
-                    {
-                        i = skill_deck.draw(i); // draw a random skill. keep original if deck is empty.
-                    }
+                    auto val = get_stab_skill(skill_deck, puppet.styles[0].element1, puppet.styles[0].element2);
+                    i = (val) ? *val : skill_deck.draw(i); // if we find a stab skill, use it. otherwise draw a random skill. keep original if deck is empty.
+                }
+                else
+                {
+                    i = skill_deck.draw(i); // draw a random skill. keep original if deck is empty.
                 }
             }
         }
+    }
 
-        /* randomize each style of a particular puppet */
-        for(auto& style : puppet.styles)
+    /* randomize each style of a particular puppet */
+    for(auto& style : puppet.styles)
+    {
+        if(style.style_type == 0)
+            continue;
+
+        /* randomize style-specific moves */
+        if(opts_.rand_skillsets)
         {
-            if(style.style_type == 0)
-                continue;
+            style.skillset.clear();
+            style.skillset = puppet.styles[0].skillset;
+            IDSet skill_set;
+            SkillDeck skill_deck;
 
-            /* randomize style-specific moves */
-            if(rand_skillsets_)
+            for(auto& i : puppet.base_skills)
+                style.skillset.insert(i);
+
+            /* level 100 move */
+            if((style.lv100_skill != 0) && !pools.lv100.empty())
             {
-                style.skillset.clear();
-                style.skillset = puppet.styles[0].skillset;
-                IDSet skill_set;
-                IDDeck skill_deck;
+                if(opts_.rand_true_rand_skills)
+                    skill_set = valid_skills_;
+                else
+                    skill_set = pools.lv100;
+                subtract_set(skill_set, style.skillset);
+                assign_skill_deck(skill_deck, skill_set, gen);
 
-                for(auto& i : puppet.base_skills)
-                    style.skillset.insert(i);
+                if(opts_.rand_prefer_same_type && chance60(gen))
+                {
+                    auto val = get_stab_skill(skill_deck, style.element1, style.element2);
+                    style.lv100_skill = (val) ? *val : skill_deck.draw(style.lv100_skill);
+                }
+                else
+                {
+                    style.lv100_skill = skill_deck.draw(style.lv100_skill);
+                }
+            }
+            style.skillset.insert(style.lv100_skill);
 
-                /* level 100 move */
-                if((style.lv100_skill != 0) && !valid_lv100_skills.empty())
+            if(opts_.rand_true_rand_skills)
+                skill_set = valid_skills_;
+            else if(style.style_type == STYLE_NORMAL)
+            {
+                skill_set = pools.base;
+                skill_set |= pools.normal;
+            }
+            else
+                skill_set = pools.evolved;
+            subtract_set(skill_set, style.skillset);
+            assign_skill_deck(skill_deck, skill_set, gen);
+
+            /* ensure every puppet starts with at least one damaging move */
+            if((style.style_type == STYLE_NORMAL) && opts_.rand_starting_move)
+            {
+                style.style_skills[0] = 56; /* default to yin energy if we don't find a match below */
+                auto val = skill_deck.draw_first([&](uint16_t id)
                 {
-                    if(rand_true_rand_skills_)
-                        skill_set = valid_skills_;
-                    else
-                        skill_set = valid_lv100_skills;
-                    subtract_set(skill_set, style.skillset);
-                    skill_deck.assign(skill_set, gen_);
+                    const SkillData& skill(skill_data(id));
+                    auto e = skill.element;
+                    return (skill.type != SKILL_TYPE_STATUS) && (skill.power > 0) && ((opts_.rand_starting_move != 1) || (e == style.element1) || (e == style.element2));
+                });
+                if(val)
+                    style.style_skills[0] = *val;
+
+                style.skillset.insert(style.style_skills[0]);
+            }
 
-                    if(rand_prefer_same_type_ && chance60(gen_))
-                    {
-                        auto val = get_stab_skill(skill_deck, style.element1, style.element2);
-                        style.lv100_skill = (val) ? *val : skill_deck.draw(style.lv100_skill);
-                    }
-                    else
-                    {
-                        style.lv100_skill = skill_deck.draw(style.lv100_skill);
-                    }
-                }
-                style.skillset.insert(style.lv100_skill);
+            /* fill in the rest of the moves */
+            for(int j = (((style.style_type == STYLE_NORMAL) && opts_.rand_starting_move) ? 1 : 0); j < 11; ++j)
+            {
+                auto& i(style.style_skills[j]);
+                if(!i)
+                    continue;
 
-                if(rand_true_rand_skills_)
-                    skill_set = valid_skills_;
-                else if(style.style_type == STYLE_NORMAL)
+                if(opts_.rand_prefer_same_type && chance60(gen))
                 {
-                    skill_set = valid_base_skills;
-                    for(auto i : valid_normal_skills)
-                        skill_set.insert(i);
+                    auto val = get_stab_skill(skill_deck, style.element1, style.element2);
+                    i = (val) ? *val : skill_deck.draw(i);
                 }
                 else
-                    skill_set = valid_evolved_skills;
-                subtract_set(skill_set, style.skillset);
-                skill_deck.assign(skill_set, gen_);
-
-                /* ensure every puppet starts with at least one damaging move */
-                if((style.style_type == STYLE_NORMAL) && rand_starting_move_)
                 {
-                    style.style_skills[0] = 56; /* default to yin energy if we don't find a match below */
-                    for(auto s = skill_deck.begin(); s != skill_deck.end(); ++s)
-                    {
-                        auto e = skills_[*s].element;
-                        if((skills_[*s].type != SKILL_TYPE_STATUS) && (skills_[*s].power > 0) && ((rand_starting_move_ != 1) || (e == style.element1) || (e == style.element2)))
-                        {
-                            style.style_skills[0] = *s;
-                            skill_deck.erase(s);
-                            break;
-                        }
-                    }
-
-                    style.skillset.insert(style.style_skills[0]);
+                    i = skill_deck.draw(i);
                 }
 
-                /* fill in the rest of the moves */
-                for(int j = (((style.style_type == STYLE_NORMAL) && rand_starting_move_) ? 1 : 0); j < 11; ++j)
-                {
-                    auto& i(style.style_skills[j]);
-                    if(!i)
-                        continue;
+                style.skillset.insert(i);
+            }
 
-                    if(rand_prefer_same_type_ && chance60(gen_))
-                    {
-                        auto val = get_stab_skill(skill_deck, style.element1, style.element2);
-                        i = (val) ? *val : skill_deck.draw(i);
-                    }
-                    else
-                    {
-                        i = skill_deck.draw(i);
-                    }
+            if(opts_.rand_true_rand_skills)
+                skill_set = valid_skills_;
+            else
+                skill_set = pools.lv70;
+            subtract_set(skill_set, style.skillset);
+            assign_skill_deck(skill_deck, skill_set, gen);
 
-                    style.skillset.insert(i);
-                }
+            /* level 70 moves */
+            for(auto& i : style.lv70_skills)
+            {
+                if(!i)
+                    continue;
 
-                if(rand_true_rand_skills_)
-                    skill_set = valid_skills_;
+                if(opts_.rand_prefer_same_type && chance60(gen))
+                {
+                    auto val = get_stab_skill(skill_deck, style.element1, style.element2);
+                    i = (val) ? *val : skill_deck.draw(i);
+                }
                 else
-                    skill_set = valid_lv70_skills;
-                subtract_set(skill_set, style.skillset);
-                skill_deck.assign(skill_set, gen_);
-
-                /* level 70 moves */
-                for(auto& i : style.lv70_skills)
                 {
-                    if(!i)
-                        continue;
-
-                    if(rand_prefer_same_type_ && chance60(gen_))
-                    {
-                        auto val = get_stab_skill(skill_deck, style.element1, style.element2);
-                        i = (val) ? *val : skill_deck.draw(i);
-                    }
-                    else
-                    {
-                        i = skill_deck.draw(i);
-                    }
-
-                    style.skillset.insert(i);
+                    i = skill_deck.draw(i);
                 }
 
-                style.skillset.erase(0);
+                style.skillset.insert(i);
+            }
 
-                /* skillcard moves */
-                memset(style.skill_compat_table, 0, sizeof(style.skill_compat_table));
-                for(auto i : skillcard_ids_)
-                {
-                    unsigned int compat_index = (i - 385) / 8;
-                    unsigned int offset = (i - 385) - (compat_index * 8);
-                    if(compat_index >= 16)
-                        continue;
+            style.skillset.erase(0);
 
-                    if(rand_prefer_same_type_)
-                    {
-                        auto e = skills_[items_[i].skill_id].element;
-                        bool same_element = ((e == style.element1) || (e == style.element2));
-                        if((same_element && chance60(gen_)) || ((!same_element) && chance25(gen_)))
-                            style.skill_compat_table[compat_index] |= (1 << offset);
-                    }
-                    else if(chance35(gen_))
-                    {
-                        style.skill_compat_table[compat_index] |= (1 << offset);
-                    }
-                }
+            /* skillcard moves, all 128 cards are decided at once */
+            if(opts_.rand_prefer_same_type)
+            {
+                SkillCompat same_element;
+                if(style.element1 < ELEMENT_MAX)
+                    same_element |= pools.card_elements[style.element1];
+                if(style.element2 < ELEMENT_MAX)
+                    same_element |= pools.card_elements[style.element2];
+
+                SkillCompat same = SkillCompat::random(compat60, gen) & same_element;
+                SkillCompat other = SkillCompat::random(compat25, gen) & ~same_element;
+                style.skill_compat = (same | other) & pools.cards;
+            }
+            else
+            {
+                style.skill_compat = SkillCompat::random(compat35, gen) & pools.cards;
             }
+        }
 
-            /* randomize abilities */
-            if(rand_abilities_)
+        /* randomize abilities */
+        if(opts_.rand_abilities)
+        {
+            memset(style.abilities, 0, sizeof(style.abilities));
+            rand_shuffle(ability_deck.begin(), ability_deck.end(), gen);
+            size_t index = 0;
+            for(int i = 0; i < 2; ++i)
             {
-                memset(style.abilities, 0, sizeof(style.abilities));
-                std::shuffle(ability_deck.begin(), ability_deck.end(), gen_);
-                size_t index = 0;
-                for(int i = 0; i < 2; ++i)
-                {
-                    /* don't give were-hakutaku to anyone other than keine */
-                    while((ability_deck[index] == 311) && (puppet.id != 62))
-                        ++index;
+                /* don't give were-hakutaku to anyone other than keine */
+                while((ability_deck[index] == 311) && (puppet.id != 62))
+                    ++index;
 
-                    /* don't give mode shift to anyone other than rika */
-                    while((ability_deck[index] == 379) && (puppet.id != 10))
-                        ++index;
+                /* don't give mode shift to anyone other than rika */
+                while((ability_deck[index] == 379) && (puppet.id != 10))
+                    ++index;
 
-                    /* don't give three bodies to anyone other than hecatia */
-                    while((ability_deck[index] == 382) && (puppet.id != 131))
-                        ++index;
+                /* don't give three bodies to anyone other than hecatia */
+                while((ability_deck[index] == 382) && (puppet.id != 131))
+                    ++index;
 
-                    assert(index < ability_deck.size());
+                assert(index < ability_deck.size());
 
-                    if((i == 0) || chance90(gen_))
-                        style.abilities[i] = ability_deck[index++];
-                }
+                if((i == 0) || chance90(gen))
+                    style.abilities[i] = ability_deck[index++];
             }
+        }
 
-            /* randomize stats */
-            if(rand_stats_)
+        /* randomize stats */
+        if(opts_.rand_stats)
+        {
+            if(opts_.rand_quota)
             {
-                if(rand_quota_)
+                sample_stat_quota(opts_.stat_quota, opts_.quota_shape, style.base_stats, gen);
+            }
+            else if(opts_.rand_true_rand_stats)
+            {
+                for(auto& i : style.base_stats)
+                    i = (uint8_t)gen_stat(gen);
+            }
+            else if(opts_.rand_stat_scaling)
+            {
+                double scale_factor = double(opts_.stat_ratio) / 100.0;
+                for(auto& i : style.base_stats)
                 {
-                    memset(style.base_stats, 0, sizeof(style.base_stats));
-                    unsigned int sum = 0;
-                    while(sum < stat_quota_)
-                    {
-                        auto& i(style.base_stats[pick_stat(gen_)]);
+                    int temp = UniformIntDist<int>(i - std::lround(i * scale_factor), i + std::lround(i * scale_factor))(gen);
+                    if(temp < 0)
+                        temp = 0;
+                    if(temp > 0xff)
+                        temp = 0xff;
 
-                        unsigned int temp = gen_quota(gen_);
-                        if((temp + (unsigned int)i) > 0xff)
-                            temp = 0xff - i;
-                        if((temp + sum) >= stat_quota_)
-                        {
-                            temp = stat_quota_ - sum;
-                            i += (uint8_t)temp;
-                            sum += temp;
-                            break;
-                        }
-                        i += (uint8_t)temp;
-                        sum += temp;
-                    }
-                }
-                else if(rand_true_rand_stats_)
-                {
-                    for(auto& i : style.base_stats)
-                        i = (uint8_t)gen_stat(gen_);
+                    i = (uint8_t)temp;
                 }
-                else if(rand_stat_scaling_)
+            }
+            else
+            {
+                if(style.style_type == STYLE_NORMAL)
                 {
-                    double scale_factor = double(stat_ratio_) / 100.0;
                     for(auto& i : style.base_stats)
                     {
-                        int temp = std::uniform_int_distribution<int>(i - std::lround(i * scale_factor), i + std::lround(i * scale_factor))(gen_);
-                        if(temp < 0)
-                            temp = 0;
-                        if(temp > 0xff)
-                            temp = 0xff;
-
-                        /* distribution statistics */
-                        #ifndef NDEBUG
-                        auto diff = (temp - i);
-                        ++a[abs(diff)];
-                        accum += diff;
-                        if(diff > amax)
-                            amax = diff;
-                        if(diff < amin)
-                            amin = diff;
-                        #endif // !NDEBUG
-
-                        i = (uint8_t)temp;
+                        assert(normal_pos > 0);
+                        if(normal_pos == 0)
+                            i = (uint8_t)gen_stat(gen);
+                        else
+                            i = normal_stats_[--normal_pos];
                     }
                 }
                 else
                 {
-                    if(style.style_type == STYLE_NORMAL)
-                    {
-                        for(auto& i : style.base_stats)
-                        {
-                            assert(!normal_stats_.empty());
-                            if(normal_stats_.empty())
-                                i = (uint8_t)gen_stat(gen_);
-                            i = normal_stats_.back();
-                            normal_stats_.pop_back();
-                        }
-                    }
-                    else
+                    for(auto& i : style.base_stats)
                     {
-                        for(auto& i : style.base_stats)
-                        {
-                            assert(!evolved_stats_.empty());
-                            if(evolved_stats_.empty())
-                                i = (uint8_t)gen_stat(gen_);
-                            i = evolved_stats_.back();
-                            evolved_stats_.pop_back();
-                        }
+                        assert(evolved_pos > 0);
+                        if(evolved_pos == 0)
+                            i = (uint8_t)gen_stat(gen);
+                        else
+                            i = evolved_stats_[--evolved_pos];
                     }
                 }
             }
         }
-
-        /* write our changes to the file buffer */
-        puppet.write(&file.data()[puppet.id * PUPPET_DATA_SIZE]);
     }
-
-    /* replace the puppet data file in the archive with our modified version */
-    if(!archive.repack_file(file))
-    {
-        error(L"Error repacking dolldata.dbs");
-        return false;
-    }
-
-    return true;
 }
 
 /* .dod files contain data for one trainer battle
  * this function randomizes the trainer puppets in a .dod file */
-void Randomizer::randomize_dod_file(void *src, const void *rand_data)
+void Randomizer::randomize_dod_file(void *src, const PuppetCipher& cipher, RandomEngine& gen) const
 {
     char *buf = (char*)src + 0x2C;
     char *endbuf = buf + (6 * PUPPET_SIZE_BOX);
-    IDDeck item_deck(held_item_ids_, gen_);
-    std::uniform_int_distribution<int> iv(0, 0xf);
-    std::uniform_int_distribution<int> ev(0, 64);
-    std::uniform_int_distribution<int> pick_ev(0, 5);
-    std::uniform_int_distribution<int> id(0, valid_puppet_ids_.size() - 1);
-    std::uniform_int_distribution<int> mark(1, 5);
-    std::uniform_int_distribution<int> costume(0, (is_ynk_ && (rand_costumes_ <= 1)) ? COSTUME_WEDDING_DRESS : COSTUME_ALT_OUTFIT);
-    std::bernoulli_distribution item_chance(trainer_item_chance_ / 100.0);
-    std::bernoulli_distribution coin_flip(0.5);
-    std::bernoulli_distribution skillcard_chance(trainer_sc_chance_ / 100.0);
-
-    if(rand_trainer_ai_)
+    IDDeck item_deck(held_item_ids_);
+    UniformIntDist<int> iv(0, 0xf);
+    UniformIntDist<int> ev(0, 64);
+    UniformIntDist<int> pick_ev(0, 5);
+    UniformIntDist<int> id(0, valid_puppet_ids_.size() - 1);
+    UniformIntDist<int> mark(1, 5);
+    UniformIntDist<int> costume(0, (is_ynk_ && (opts_.rand_costumes <= 1)) ? COSTUME_WEDDING_DRESS : COSTUME_ALT_OUTFIT);
+    BernoulliDist item_chance(opts_.trainer_item_chance / 100.0);
+    BernoulliDist coin_flip(0.5);
+    BernoulliDist skillcard_chance(opts_.trainer_sc_chance / 100.0);
+
+    if(opts_.rand_trainer_ai)
         ((char*)src)[0x2B] = 2;
 
     unsigned int max_lvl = 0;
-    double lvl_mul = double(level_mod_) / 100.0;
-    auto min_style = (rand_evolved_trainers_ ? 1 : 0);
+    double lvl_mul = double(opts_.level_mod) / 100.0;
+    auto min_style = (opts_.rand_evolved_trainers ? 1 : 0);
     for(char *pos = buf; pos < endbuf; pos += PUPPET_SIZE_BOX)
     {
-        decrypt_puppet(pos, rand_data, PUPPET_SIZE);
+        cipher.decrypt(pos);
 
         Puppet puppet(pos, false);
 
         /* if we've changed puppet costs, trainer puppets will have exp based on a different cost value.
          * use the old cost value to determine the correct level. */
-        assert(!rand_cost_ || !puppet.puppet_id || old_costs_.count(puppet.puppet_id));
-        unsigned int lvl = (rand_cost_) ? level_from_exp(old_costs_[puppet.puppet_id], puppet.exp) : level_from_exp(puppets_[puppet.puppet_id], puppet.exp);
+        assert(!opts_.rand_cost || !puppet.puppet_id || old_costs_.count(puppet.puppet_id));
+        unsigned int lvl = (opts_.rand_cost) ? level_from_exp(old_cost(puppet.puppet_id), puppet.exp) : level_from_exp(puppet_data(puppet.puppet_id), puppet.exp);
 
-        if(level_mod_ != 100)
+        if(opts_.level_mod != 100)
             lvl = (unsigned int)(double(lvl) * lvl_mul);
         if(lvl > 100)
             lvl = 100;
@@ -976,20 +1364,20 @@ void Randomizer::randomize_dod_file(void *src, const void *rand_data)
         if(lvl < 30)
             puppet.style_index = 0;
 
-        if(((puppet.puppet_id == 0) && rand_full_party_) || ((puppet.puppet_id != 0) && rand_trainers_))
+        if(((puppet.puppet_id == 0) && opts_.rand_full_party) || ((puppet.puppet_id != 0) && opts_.rand_trainers))
         {
             if(puppet.puppet_id == 0)
             {
                 memset(pos, 0, PUPPET_SIZE);
             }
 
-            PuppetData& data(puppets_[valid_puppet_ids_[id(gen_)]]);
+            const PuppetData& data(puppet_data(valid_puppet_ids_[id(gen)]));
             puppet.puppet_id = data.id;
-            puppet.mark = (uint8_t)mark(gen_);
+            puppet.mark = (uint8_t)mark(gen);
 
             assert(data.max_style_index() > 0);
             if(lvl >= 30)
-                puppet.style_index = (uint8_t)std::uniform_int_distribution<unsigned int>(min_style, data.max_style_index())(gen_);
+                puppet.style_index = (uint8_t)UniformIntDist<unsigned int>(min_style, data.max_style_index())(gen);
             else
                 puppet.style_index = 0;
 
@@ -998,19 +1386,13 @@ void Randomizer::randomize_dod_file(void *src, const void *rand_data)
             IDSet skill_set = style.skillset;
             IDSet skillcards;
 
-            for(unsigned int i = 0; i < 16; ++i)
+            style.skill_compat.for_each([&](unsigned int bit)
             {
-                for(unsigned int j = 0; j < 8; ++j)
-                {
-                    if(style.skill_compat_table[i] & (1 << j))
-                    {
-                        skillcards.insert((uint16_t)items_[385 + (8 * i) + j].skill_id);
-                    }
-                }
-            }
+                skillcards.insert((uint16_t)item_data(SKILLCARD_FIRST_ITEM + bit).skill_id);
+            });
 
             /* remove skills that are too high level for the current puppet */
-            if(rand_strict_trainers_)
+            if(opts_.rand_strict_trainers)
             {
                 auto iter = skill_set.begin();
                 while(iter != skill_set.end())
@@ -1025,26 +1407,25 @@ void Randomizer::randomize_dod_file(void *src, const void *rand_data)
             }
 
             /* no duplicates */
-            for(auto i : skill_set)
-                skillcards.erase(i);
+            subtract_set(skillcards, skill_set);
 
             /* when using shuffle method, pool all skills together */
-            if(rand_trainer_sc_shuffle_)
-                skill_set.insert(skillcards.begin(), skillcards.end());
+            if(opts_.rand_trainer_sc_shuffle)
+                skill_set |= skillcards;
 
-            IDDeck skill_deck(skill_set, gen_);
+            IDDeck skill_deck(skill_set);
             IDDeck skillcard_deck;
 
-            if(!rand_trainer_sc_shuffle_)
-                skillcard_deck.assign(skillcards, gen_);
+            if(!opts_.rand_trainer_sc_shuffle)
+                skillcard_deck.assign(skillcards);
 
             bool has_sign_skill = false;
             for(auto& i : puppet.skills)
             {
-                if(!rand_trainer_sc_shuffle_ && skillcard_chance(gen_))
-                    i = skillcard_deck.draw(0);
+                if(!opts_.rand_trainer_sc_shuffle && skillcard_chance(gen))
+                    i = skillcard_deck.draw(gen, 0);
                 else
-                    i = skill_deck.draw(0);
+                    i = skill_deck.draw(gen, 0);
                 
                 /* check if we have a sign skill now, and if so remove all other sign skills from the pool */
                 if(!has_sign_skill && is_sign_skill(i))
@@ -1074,14 +1455,14 @@ void Randomizer::randomize_dod_file(void *src, const void *rand_data)
             }
 
             for(auto& i : puppet.ivs)
-                i = (uint8_t)iv(gen_);
+                i = (uint8_t)iv(gen);
 
             memset(puppet.evs, 0, sizeof(puppet.evs));
             int total = 0;
             while(total < 130)
             {
-                int j = ev(gen_);
-                int k = pick_ev(gen_);
+                int j = ev(gen);
+                int k = pick_ev(gen);
                 if((puppet.evs[k] + j) > 64)
                     j = 64 - puppet.evs[k];
                 if((total + j) > 130)
@@ -1090,40 +1471,40 @@ void Randomizer::randomize_dod_file(void *src, const void *rand_data)
                 puppet.evs[k] += (uint8_t)j;
             }
 
-            puppet.ability_index = coin_flip(gen_) ? 1 : 0;
+            puppet.ability_index = coin_flip(gen) ? 1 : 0;
             if(data.styles[puppet.style_index].abilities[puppet.ability_index] == 0)
                 puppet.ability_index = 0;
 
             /* TODO: allow leaving items unchanged */
-            if(item_chance(gen_))
-                puppet.held_item_id = item_deck.draw(0);
+            if(item_chance(gen))
+                puppet.held_item_id = item_deck.draw(gen, 0);
             else
                 puppet.held_item_id = 0;
 
             assert(puppet.puppet_id < puppet_names_.size());
             if(puppet.puppet_id < puppet_names_.size())
-                puppet.set_puppet_nickname(puppet_names_[puppet.puppet_id]);
+                puppet.set_puppet_nickname(strings_.str(puppet_names_[puppet.puppet_id]));
         }
 
         if(puppet.puppet_id)
         {
-            if(rand_trainer_max_ivs_)
+            if(opts_.rand_trainer_max_ivs)
                 memset(puppet.ivs, 0x0F, sizeof(puppet.ivs));
-            if(rand_trainer_max_evs_)
+            if(opts_.rand_trainer_max_evs)
                 memset(puppet.evs, 64, sizeof(puppet.evs));
-            if(rand_costumes_)
+            if(opts_.rand_costumes)
             {
-                puppet.costume_index = (uint8_t)costume(gen_);
-                assert((puppet.costume_index < COSTUME_WEDDING_DRESS) || (rand_costumes_ > 1));
+                puppet.costume_index = (uint8_t)costume(gen);
+                assert((puppet.costume_index < COSTUME_WEDDING_DRESS) || (opts_.rand_costumes > 1));
                 if(puppet.costume_index == COSTUME_WEDDING_DRESS)
                     puppet.set_heart_mark(true);
             }
-            puppet.exp = exp_for_level(puppets_[puppet.puppet_id], lvl);
+            puppet.exp = exp_for_level(puppet_data(puppet.puppet_id), lvl);
             assert(((lvl < 30) && (puppet.style_index == 0)) || (lvl >= 30));
             puppet.write(pos, false);
         }
 
-        encrypt_puppet(pos, rand_data, PUPPET_SIZE);
+        cipher.encrypt(pos);
     }
 }
 
@@ -1131,8 +1512,10 @@ void Randomizer::randomize_dod_file(void *src, const void *rand_data)
  * and feeds them to randomize_dod_file() */
 bool Randomizer::randomize_trainers(Archive& archive, ArcFile& rand_data)
 {
-    if(rand_trainers_ || rand_full_party_ || (level_mod_ != 100) || rand_cost_
-        || rand_trainer_ai_ || rand_trainer_max_ivs_ || rand_trainer_max_evs_ || rand_costumes_)
+    PROFILE_SCOPE("randomize_trainers");
+
+    if(opts_.rand_trainers || opts_.rand_full_party || (opts_.level_mod != 100) || opts_.rand_cost
+        || opts_.rand_trainer_ai || opts_.rand_trainer_max_ivs || opts_.rand_trainer_max_evs || opts_.rand_costumes)
     {
         int dir_index = archive.get_index("script/dollOperator");
         if(dir_index < 0)
@@ -1149,29 +1532,53 @@ bool Randomizer::randomize_trainers(Archive& archive, ArcFile& rand_data)
             return false;
         }
 
-        int step = (end_index - index) / 12;
-        int count = 0;
+        /* collect the trainer files up front so they can be randomized in parallel.
+         * each file gets its own RNG stream, seeded in file order from the main generator,
+         * so the result doesn't depend on how the work is scheduled across threads */
+        std::vector<int> dod_files;
+        std::vector<RandomEngine::result_type> seeds;
         for(; index < end_index; ++index)
+        {
+            if(archive.get_filename(index).find(".DOD") == std::string::npos)
+                continue;
+
+            dod_files.push_back(index);
+            seeds.push_back(gen_());
+        }
+
+        std::vector<ArcFile> files(dod_files.size());
+        std::size_t steps = 0;
+        PuppetCipher cipher(rand_data.data());
+
+        /* the archive is only read from here on, nothing is repacked until all workers are done */
+        parallel_for(dod_files.size(), [&](std::size_t i)
+        {
+            ArcFile file = archive.get_file(dod_files[i]);
+            if(!file)
+                return; /* reported below */
+
+            RandomEngine gen(seeds[i]);
+            randomize_dod_file(file.data(), cipher, gen);
+            files[i] = std::move(file);
+        },
+        [&](std::size_t done)
         {
             /* update progress bar */
-            if(++count > step)
-            {
+            for(; steps < (done * 12) / dod_files.size(); ++steps)
                 increment_progress_bar();
-                count = 0;
-            }
+        });
 
-            if(archive.get_filename(index).find(".DOD") == std::string::npos)
-                continue;
+        PROFILE_ADD(PROFILE_ENTRIES, dod_files.size());
 
-            ArcFile file;
-            if(!(file = archive.get_file(index)))
+        /* commit all the randomized files to the archive */
+        for(const auto& file : files)
+        {
+            if(!file)
             {
                 error(L"Error iterating dollOperator directory");
                 return false;
             }
 
-            randomize_dod_file(file.data(), rand_data.data());
-
             if(!archive.repack_file(file))
             {
                 error(L"Error repacking .dod file");
@@ -1185,6 +1592,8 @@ bool Randomizer::randomize_trainers(Archive& archive, ArcFile& rand_data)
 
 bool Randomizer::randomize_skills(Archive& archive)
 {
+    PROFILE_SCOPE("randomize_skills");
+
     ArcFile file;
     if(!(file = archive.get_file(is_ynk_ ? "doll/SkillData.sbs" : "doll/skill/SkillData.sbs")))
     {
@@ -1197,7 +1606,7 @@ bool Randomizer::randomize_skills(Archive& archive)
 
     IDSet skills = valid_skills_;
     for(auto i : skillcard_ids_)
-        skills.insert((uint16_t)items_[i].skill_id);
+        skills.insert((uint16_t)item_data(i).skill_id);
 
     for(auto i : skills)
     {
@@ -1207,27 +1616,29 @@ bool Randomizer::randomize_skills(Archive& archive)
         acc_deck.push_back(skill.accuracy);
         sp_deck.push_back(skill.sp);
         prio_deck.push_back(skill.priority);
-        skills_[i] = skill;
+        skills_.insert(i, skill);
     }
 
+    PROFILE_ADD(PROFILE_ENTRIES, skills.size());
+
     if(!rand_skills_)
         return true;
 
-    std::shuffle(power_deck.begin(), power_deck.end(), gen_);
-    std::shuffle(acc_deck.begin(), acc_deck.end(), gen_);
-    std::shuffle(sp_deck.begin(), sp_deck.end(), gen_);
-    std::shuffle(prio_deck.begin(), prio_deck.end(), gen_);
+    rand_shuffle(power_deck.begin(), power_deck.end(), gen_);
+    rand_shuffle(acc_deck.begin(), acc_deck.end(), gen_);
+    rand_shuffle(sp_deck.begin(), sp_deck.end(), gen_);
+    rand_shuffle(prio_deck.begin(), prio_deck.end(), gen_);
 
-    std::uniform_int_distribution<int> element(1, is_ynk_ ? ELEMENT_WARPED : ELEMENT_DREAM);
-    std::bernoulli_distribution type(0.5);
+    UniformIntDist<int> element(1, is_ynk_ ? ELEMENT_WARPED : ELEMENT_DREAM);
+    BernoulliDist type(0.5);
 
     int step = skills.size() / 25;
     int count = 0;
     unsigned int index = 0;
 
-    for(auto& it : skills_)
+    for(auto it = skills_.begin(); it != skills_.end(); ++it)
     {
-        SkillData& skill(it.second);
+        SkillData& skill(*it);
 
         if(++count > step)
         {
@@ -1235,29 +1646,31 @@ bool Randomizer::randomize_skills(Archive& archive)
             count = 0;
         }
 
-        if(rand_skill_element_)
+        if(opts_.rand_skill_element)
             skill.element = (uint8_t)element(gen_);
 
         assert(index < power_deck.size());
-        if(rand_skill_power_)
+        if(opts_.rand_skill_power)
             skill.power = power_deck[index];
 
         assert(index < acc_deck.size());
-        if(rand_skill_acc_)
+        if(opts_.rand_skill_acc)
             skill.accuracy = acc_deck[index];
 
         assert(index < sp_deck.size());
-        if(rand_skill_sp_)
+        if(opts_.rand_skill_sp)
             skill.sp = sp_deck[index];
 
         assert(index < prio_deck.size());
-        if(rand_skill_prio_)
+        if(opts_.rand_skill_prio)
             skill.priority = prio_deck[index];
 
-        if(rand_skill_type_ && (skill.type != SKILL_TYPE_STATUS))
+        if(opts_.rand_skill_type && (skill.type != SKILL_TYPE_STATUS))
             skill.type = (uint16_t)(type(gen_) ? SKILL_TYPE_FOCUS : SKILL_TYPE_SPREAD);
 
-        skill.write(&buf[it.first * SKILL_DATA_SIZE]);
+        /* only the fields that changed are written back */
+        char *rec = &buf[it.id() * SKILL_DATA_SIZE];
+        layout_write(g_skill_layout, skill, rec, layout_diff(g_skill_layout, SkillData(rec), skill));
         ++index;
     }
 
@@ -1274,9 +1687,9 @@ bool Randomizer::randomize_skills(Archive& archive)
 void Randomizer::randomize_mad_file(void *data)
 {
     MADData mad(data);
-    std::uniform_int_distribution<unsigned int> gen_normal(1, 10);
-    std::uniform_int_distribution<unsigned int> gen_special(1, 5);
-    std::uniform_int_distribution<unsigned int> gen_weight(1, 20); //max in base tpdp is ~25, reduced for less drastic RNG
+    UniformIntDist<unsigned int> gen_normal(1, 10);
+    UniformIntDist<unsigned int> gen_special(1, 5);
+    UniformIntDist<unsigned int> gen_weight(1, 20); //max in base tpdp is ~25, reduced for less drastic RNG
     std::vector<MADEncounter> encounters;
     std::vector<MADEncounter> special_encounters;
 
@@ -1291,13 +1704,13 @@ void Randomizer::randomize_mad_file(void *data)
     }
 
     /* skip this file if no puppets live here */
-    if(encounters.empty() && special_encounters.empty() && !rand_bike_everywhere_ && !rand_gap_map_everywhere_)
+    if(encounters.empty() && special_encounters.empty() && !opts_.rand_bike_everywhere && !opts_.rand_gap_map_everywhere)
         return;
 
     /* adjust puppet levels */
-    if(level_mod_ != 100)
+    if(opts_.level_mod != 100)
     {
-        double mod = double(level_mod_) / 100.0;
+        double mod = double(opts_.level_mod) / 100.0;
         for(auto& i : encounters)
         {
             double newlvl = (double(i.level) * mod);
@@ -1315,9 +1728,9 @@ void Randomizer::randomize_mad_file(void *data)
     }
 
     /* encounter randomization */
-    if(rand_encounters_)
+    if(opts_.rand_encounters)
     {
-        if(rand_encounters_ == 1)
+        if(opts_.rand_encounters == 1)
         {
             /* since there's no way to tell what areas have what type of grass,
              * we won't add any puppets to any grass type if we don't find some there already */
@@ -1389,7 +1802,7 @@ void Randomizer::randomize_mad_file(void *data)
             i.id = puppet_id_pool_.draw(gen_);
 
             if(i.level >= 32)
-                i.style = (uint8_t)std::uniform_int_distribution<unsigned int>(0, puppets_[i.id].max_style_index())(gen_);
+                i.style = (uint8_t)UniformIntDist<unsigned int>(0, puppet_data(i.id).max_style_index())(gen_);
             else
                 i.style = 0;
         }
@@ -1398,65 +1811,72 @@ void Randomizer::randomize_mad_file(void *data)
             i.id = puppet_id_pool_.draw(gen_);
 
             if(i.level >= 32)
-                i.style = (uint8_t)std::uniform_int_distribution<unsigned int>(0, puppets_[i.id].max_style_index())(gen_);
+                i.style = (uint8_t)UniformIntDist<unsigned int>(0, puppet_data(i.id).max_style_index())(gen_);
             else
                 i.style = 0;
         }
     }
 
     /* Gap map and bike modifiers */
-    if(rand_bike_everywhere_)
+    if(opts_.rand_bike_everywhere)
         mad.bike_disabled[0] = 0;
 
-    if(rand_gap_map_everywhere_)
+    if(opts_.rand_gap_map_everywhere)
         mad.gap_map_disabled[0] = 0;
 
     /* dump statistics */
-    if(rand_export_locations_)
+    if(opts_.rand_export_locations)
     {
         int weight_sum = 0;
         int special_weight_sum = 0;
-        std::wstring loc_name;
+        std::string loc_name;
 
         mad.location_name[31] = 0; /* ensure null-terminated */
         if(mad.location_name[0])
-            loc_name = sjis_to_utf(mad.location_name);
+            loc_name = sjis_to_utf8(mad.location_name);
 
         if(!loc_name.empty())
         {
-            location_names_.insert(loc_name);
-            auto c = location_names_.count(loc_name);
+            Symbol sym = strings_.intern(loc_name);
+            if(sym >= location_counts_.size())
+                location_counts_.resize(strings_.size());
+            auto c = ++location_counts_[sym];
             if(c > 1)
-                loc_name += L" [" + std::to_wstring(c) + L"]";
+                loc_name += " [" + std::to_string(c) + "]";
         }
         else
-            loc_name = L"Unknown Location";
+            loc_name = "Unknown Location";
 
         for(auto& i : encounters)
             weight_sum += i.weight;
         for(auto& i : special_encounters)
             special_weight_sum += i.weight;
 
+        /* text strings describing the puppets that may be caught in this location (used with "export catch locations" option).
+         * built in one buffer, the pool keeps its own copy */
+        std::string label;
+        char buf[64];
+
         for(auto& i : encounters)
         {
-            std::wostringstream percentage;
-            percentage.precision(3);
-            percentage << (((double)i.weight / (double)weight_sum) * 100.0);
-
-            /* text string describing the puppets that may be caught in this location (used with "export catch locations" option) */
-            loc_map_[i.id].insert(loc_name + L" (" + puppets_[i.id].styles[i.style].style_string() + L") " + percentage.str() + L'%' + L" lvl " + std::to_wstring(i.level));
+            snprintf(buf, sizeof(buf), ") %.3g%% lvl %d", ((double)i.weight / (double)weight_sum) * 100.0, (int)i.level);
+            label.assign(loc_name);
+            label += " (";
+            label += puppet_data(i.id).styles[i.style].style_string();
+            label += buf;
+            add_catch_location(i.id, label);
         }
 
-        loc_name += L" (blue grass)";
+        loc_name += " (blue grass)";
 
         for(auto& i : special_encounters)
         {
-            std::wostringstream percentage;
-            percentage.precision(3);
-            percentage << (((double)i.weight / (double)special_weight_sum) * 100.0);
-
-            /* text string describing the puppets that may be caught in this location (used with "export catch locations" option) */
-            loc_map_[i.id].insert(loc_name + L" (" + puppets_[i.id].styles[i.style].style_string() + L") " + percentage.str() + L'%' + L" lvl " + std::to_wstring(i.level));
+            snprintf(buf, sizeof(buf), ") %.3g%% lvl %d", ((double)i.weight / (double)special_weight_sum) * 100.0, (int)i.level);
+            label.assign(loc_name);
+            label += " (";
+            label += puppet_data(i.id).styles[i.style].style_string();
+            label += buf;
+            add_catch_location(i.id, label);
         }
     }
 
@@ -1470,13 +1890,26 @@ void Randomizer::randomize_mad_file(void *data)
     mad.write(data);
 }
 
+/* the label lists work like sets, each label appears once */
+void Randomizer::add_catch_location(unsigned int puppet_id, std::string_view label)
+{
+    Symbol sym = strings_.intern(label);
+    auto& labels = loc_map_[puppet_id];
+
+    auto it = std::lower_bound(labels.begin(), labels.end(), sym);
+    if((it == labels.end()) || (*it != sym))
+        labels.insert(it, sym);
+}
+
 /* randomize how effective each element is against other elements.
  * the data for this is a csv text file (Compatibility.csv) arranged like a multiplication table.
  * row is source, column is target. see the type chart on the wiki for reference.
  * 0 = immune, 1 = not effective, 2 = neutral, 4 = super effective. */
 bool Randomizer::randomize_compatibility(Archive& archive)
 {
-    if(!rand_compat_)
+    PROFILE_SCOPE("randomize_compatibility");
+
+    if(!opts_.rand_compat)
         return true;
 
     ArcFile file;
@@ -1493,20 +1926,22 @@ bool Randomizer::randomize_compatibility(Archive& archive)
         return false;
     }
 
-    wchar_t chars[] = {L'0', L'1', L'2', L'4'};
+    char chars[] = {'0', '1', '2', '4'};
 
     /* weight randomization towards neutral */
-    std::discrete_distribution<int> dist({ 6, 35, 165, 35 });
+    DiscreteDist dist({ 6, 35, 165, 35 });
 
     for(std::size_t line = 2; line < csv.num_lines(); ++line) // skip descriptor and null element
     {
         for(std::size_t field = 2; field < csv.num_fields(); ++field) // skip descriptor and null element
         {
             auto r = dist(gen_);
-            csv[line][field] = chars[r];
+            csv.set_field(line, field, std::string(1, chars[r]));
         }
     }
 
+    PROFILE_ADD(PROFILE_ENTRIES, (csv.num_lines() - 2) * (csv.num_fields() - 2));
+
     auto new_csv = csv.to_string();
 
     if(!archive.repack_file(file.file_index(), new_csv.data(), new_csv.size()))
@@ -1521,7 +1956,9 @@ bool Randomizer::randomize_compatibility(Archive& archive)
 /* searches through the archive for .mad files and feeds them to randomize_mad_file() */
 bool Randomizer::randomize_wild_puppets(Archive& archive)
 {
-    if(rand_encounters_ || rand_export_locations_ || (level_mod_ != 100) || rand_bike_everywhere_ || rand_gap_map_everywhere_)
+    PROFILE_SCOPE("randomize_wild_puppets");
+
+    if(opts_.rand_encounters || opts_.rand_export_locations || (opts_.level_mod != 100) || opts_.rand_bike_everywhere || opts_.rand_gap_map_everywhere)
     {
         int dir_index = archive.get_index("map/data");
         if(dir_index < 0)
@@ -1572,8 +2009,9 @@ bool Randomizer::randomize_wild_puppets(Archive& archive)
                 }
 
                 randomize_mad_file(file.data());
+                PROFILE_ADD(PROFILE_ENTRIES, 1);
 
-                if(rand_encounters_ || (level_mod_ != 100) || rand_bike_everywhere_ || rand_gap_map_everywhere_) /* don't repack if we're just dumping catch locations */
+                if(opts_.rand_encounters || (opts_.level_mod != 100) || opts_.rand_bike_everywhere || opts_.rand_gap_map_everywhere) /* don't repack if we're just dumping catch locations */
                 {
                     if(!archive.repack_file(file))
                     {
@@ -1593,7 +2031,9 @@ bool Randomizer::randomize_wild_puppets(Archive& archive)
 /* Used for parsing the .obs files (mapping events to a given map) to e.g. modify the trainers behavior */
 bool Randomizer::parse_map_events(Archive& archive)
 {
-    if(rand_blind_trainers_)
+    PROFILE_SCOPE("parse_map_events");
+
+    if(opts_.rand_blind_trainers)
     {
         int dir_index = archive.get_index("map/data");
         if(dir_index < 0)
@@ -1637,6 +2077,7 @@ bool Randomizer::parse_map_events(Archive& archive)
             }
 
             blind_trainers_in_obs_file(file.data());
+            PROFILE_ADD(PROFILE_ENTRIES, 1);
 
             if(!archive.repack_file(file))
             {
@@ -1676,16 +2117,16 @@ bool Randomizer::parse_puppet_names(Archive& archive)
         return false;
     }
 
-    auto utf = sjis_to_utf(file.data(), file.size());
+    auto utf = sjis_to_utf8(file.data(), file.size());
 
     std::size_t pos = 0;
-    std::size_t endpos = utf.find(L"\r\n");
+    std::size_t endpos = utf.find("\r\n");
 
     while(endpos != std::string::npos)
     {
-        puppet_names_.push_back(utf.substr(pos, endpos - pos));
+        puppet_names_.push_back(strings_.intern(std::string_view(utf).substr(pos, endpos - pos)));
         pos = endpos + 2;
-        endpos = utf.find(L"\r\n", pos);
+        endpos = utf.find("\r\n", pos);
     }
 
     return true;
@@ -1696,30 +2137,50 @@ bool Randomizer::randomize(const std::wstring& dir, unsigned int seed)
     Archive archive;
     std::wstring path;
 
-    /* here we will store modified files until randomization is complete.
-     * this prevents leaving the game files partially randomized if we encounter
-     * an error mid-randomization.
-     * most of the files are less than 10MB so this should be fine */
-    std::map<std::wstring, Archive> write_queue; // Key is filepath
+    /* modified archives are written to temporary files in the background while
+     * the later stages run, and only moved over the game files once randomization
+     * is complete. this prevents leaving the game files partially randomized
+     * if we encounter an error mid-randomization */
+    ArchiveWriter writer;
 
-    if(!path_exists(dir))
+    if((buffers_ == nullptr) && !path_exists(dir))
     {
         error(L"Invalid folder selected, please locate the game folder");
         return false;
     }
 
-    gen_.seed(seed);
+    /* start from a clean slate, anything carried over from a previous run
+     * comes from the stage cache */
+    clear();
+    seed_ = seed;
 
-    rand_skills_ = rand_skill_element_ || rand_skill_power_ || rand_skill_acc_ || rand_skill_sp_ || rand_skill_prio_ || rand_skill_type_;
-    rand_puppets_ = rand_skillsets_ || rand_stats_ || rand_types_ || rand_abilities_ || rand_cost_;
+    PROFILE_RESET();
+
+    rand_skills_ = opts_.rand_skill_element || opts_.rand_skill_power || opts_.rand_skill_acc || opts_.rand_skill_sp || opts_.rand_skill_prio || opts_.rand_skill_type;
+    rand_puppets_ = opts_.rand_skillsets || opts_.rand_stats || opts_.rand_types || opts_.rand_abilities || opts_.rand_cost;
+
+    /* the GUI never passes more than 100, other callers might */
+    opts_.trainer_sc_chance = std::min(opts_.trainer_sc_chance, 100u);
+    opts_.trainer_item_chance = std::min(opts_.trainer_item_chance, 100u);
 
     path = dir + L"/dat/gn_dat1.arc";
+    auto dat1_archive = open_archive_async(dir, L"gn_dat1.arc");
 
-    if(!open_archive(archive, path))
+    if(!open_archive(archive, dat1_archive, path))
         return false;
 
     is_ynk_ = archive.is_ynk();
 
+    /* start reading the archives we're going to need while we work on the current one */
+    std::wstring data_name = is_ynk_ ? L"gn_dat6.arc" : L"gn_dat3.arc";
+    std::wstring map_name = L"gn_dat5.arc";
+    std::wstring data_path = dir + L"/dat/" + data_name;
+    std::wstring map_path = dir + L"/dat/" + map_name;
+    std::future<Archive> data_archive = open_archive_async(dir, data_name);
+    std::future<Archive> map_archive;
+    if(is_ynk_)
+        map_archive = open_archive_async(dir, map_name);
+
     /* ---encryption random data source--- */
     ArcFile rand_data;
 
@@ -1729,123 +2190,176 @@ bool Randomizer::randomize(const std::wstring& dir, unsigned int seed)
         return false;
     }
 
-    path = dir + (is_ynk_ ? L"/dat/gn_dat6.arc" : L"/dat/gn_dat3.arc");
+    /* the hashes identify the input of the cached stages and the base of a patch, otherwise they're unused */
+    bool need_hashes = caching() || opts_.write_patch;
+    uint64_t rand_data_hash = need_hashes ? Hasher().add(rand_data.data(), rand_data.size()).value() : 0;
 
-    if(!open_archive(archive, path))
-        return false;
-
-    if(!parse_puppets(archive))
-        return false;
+    path = data_path;
 
-    if(!parse_items(archive))
+    if(!open_archive(archive, data_archive, path))
         return false;
 
-    if(!parse_skill_names(archive))
-        return false;
+    uint64_t data_hash = need_hashes ? archive.content_hash() : 0;
 
-    if(!parse_ability_names(archive))
+    if(!run_stage(STAGE_PARSE, archive, data_hash, [&]() {
+        return parse_puppets(archive) && parse_items(archive) && parse_skill_names(archive) && parse_ability_names(archive); }))
         return false;
 
-    if(!randomize_skills(archive))
+    if(!run_stage(STAGE_SKILLS, archive, data_hash, [&]() { return randomize_skills(archive); }))
         return false;
 
     set_progress_bar(25);
 
-    if(!randomize_puppets(archive))
+    if(!run_stage(STAGE_PUPPETS, archive, data_hash, [&]() { return randomize_puppets(archive); }))
         return false;
 
-    if(!randomize_compatibility(archive))
+    if(!run_stage(STAGE_COMPAT, archive, data_hash, [&]() { return randomize_compatibility(archive); }))
         return false;
 
-    if(!export_compat(archive, dir + L"/type_chart.txt"))
+    if((output_ == nullptr) && !export_compat(archive, dir + L"/type_chart.txt"))
         return false;
 
     set_progress_bar(50);
 
+    uint64_t map_hash = data_hash;
+
+    /* in patch mode the game files are left alone and only the changes are written out */
+    Patch patch;
+
     if(is_ynk_)
     {
-        write_queue[path] = std::move(archive);
+        if(opts_.write_patch)
+            add_patch_files(patch.add_target(utf_narrow(data_name), data_hash), archive, STAGE_PARSE, STAGE_COMPAT);
+        else if(output_ != nullptr)
+            output_->archives[data_name] = std::move(archive);
+        else
+            writer.write(std::move(archive), path);
 
-        path = dir + L"/dat/gn_dat5.arc";
+        path = map_path;
 
-        if(!open_archive(archive, path))
+        if(!open_archive(archive, map_archive, path))
             return false;
+
+        map_hash = need_hashes ? archive.content_hash() : 0;
     }
 
-    if(!parse_puppet_names(archive))
+    if(!run_stage(STAGE_NAMES, archive, map_hash, [&]() { return parse_puppet_names(archive); }))
         return false;
 
-    if(!randomize_trainers(archive, rand_data))
+    if(!run_stage(STAGE_TRAINERS, archive, Hasher().add(map_hash).add(rand_data_hash).value(), [&]() { return randomize_trainers(archive, rand_data); }))
         return false;
 
-    if(!parse_map_events(archive))
+    if(!run_stage(STAGE_MAP_EVENTS, archive, map_hash, [&]() { return parse_map_events(archive); }))
         return false;
 
     set_progress_bar(75);
 
-    if(!randomize_wild_puppets(archive))
+    if(!run_stage(STAGE_WILD, archive, map_hash, [&]() { return randomize_wild_puppets(archive); }))
         return false;
 
-    if(!save_archive(archive, path))
-        return false;
+    if(opts_.write_patch)
+    {
+        if(is_ynk_)
+            add_patch_files(patch.add_target(utf_narrow(map_name), map_hash), archive, STAGE_NAMES, STAGE_WILD);
+        else
+            add_patch_files(patch.add_target(utf_narrow(data_name), data_hash), archive, STAGE_PARSE, STAGE_WILD);
 
-    for(auto& it : write_queue)
+        if(output_ != nullptr)
+        {
+            output_->patch = std::move(patch);
+        }
+        else if(!patch.save(dir + L"/randomizer.patch"))
+        {
+            error(L"Could not write to file: " + dir + L"/randomizer.patch");
+            return false;
+        }
+    }
+    else if(output_ != nullptr)
     {
-        if(!save_archive(it.second, it.first))
+        output_->archives[is_ynk_ ? map_name : data_name] = std::move(archive);
+    }
+    else
+    {
+        writer.write(std::move(archive), path);
+
+        if(!commit_archives(writer))
             return false;
     }
 
-    if(rand_export_locations_)
+    if(output_ != nullptr)
+        return true;
+
+    if(opts_.rand_export_locations)
         export_locations(dir + L"/catch_locations.txt");
 
-    if(rand_export_puppets_)
+    if(opts_.rand_export_puppets)
         export_puppets(dir + L"/puppets.txt");
 
+#ifdef TPDP_PROFILE
+    /* dry runs can call profile_report() themselves */
+    std::string report = profile_report();
+    write_file(dir + L"/profile.json", report.data(), report.size());
+#endif
+
     return true;
 }
 
-void Randomizer::decrypt_puppet(void *src, const void *rand_data, std::size_t len)
+bool Randomizer::randomize(const std::wstring& dir, unsigned int seed, RandomizerOutput& out)
 {
-    uint8_t *buf = (uint8_t*)src;
-    const uint8_t *randbuf = (const uint8_t*)rand_data;
+    out.archives.clear();
+    out.patch = Patch();
 
-    for(unsigned int i = 0; i < (len / 3); ++i)
-    {
-        int index = (i * 3) % len;
-        uint32_t crypto = read_le32(&randbuf[(i * 4) & 0x3fff]);
+    output_ = &out;
+    bool ret = randomize(dir, seed);
+    output_ = nullptr;
 
-        /* need the higher half of this multiplication, right shifted 1 */
-        uint32_t temp = (uint64_t(uint64_t(0xAAAAAAABu) * uint64_t(crypto)) >> 33);
-        temp *= 3;
+    return ret;
+}
 
-        if(crypto - temp == 0)
-            buf[index] = ~buf[index];
-        buf[index] -= uint8_t(crypto);
-    }
+bool Randomizer::randomize(const ArchiveBuffers& files, unsigned int seed, RandomizerOutput& out)
+{
+    buffers_ = &files;
+    bool ret = randomize(std::wstring(), seed, out);
+    buffers_ = nullptr;
+
+    return ret;
 }
 
-void Randomizer::encrypt_puppet(void *src, const void *rand_data, std::size_t len)
+/* read-only lookups that don't insert missing entries into the maps,
+ * so they're safe to call from worker threads */
+const PuppetData& Randomizer::puppet_data(unsigned int id) const
 {
-    uint8_t *buf = (uint8_t*)src;
-    const uint8_t *randbuf = (const uint8_t*)rand_data;
+    static const PuppetData empty;
+    auto puppet = puppets_.find(id);
+    return puppet ? *puppet : empty;
+}
 
-    for(unsigned int i = 0; i < (len / 3); ++i)
-    {
-        int index = (i * 3) % len;
-        uint32_t crypto = read_le32(&randbuf[(i * 4) & 0x3fff]);
+const SkillData& Randomizer::skill_data(unsigned int id) const
+{
+    static const SkillData empty;
+    auto skill = skills_.find(id);
+    return skill ? *skill : empty;
+}
 
-        uint32_t temp = (uint64_t(uint64_t(0xAAAAAAABu) * uint64_t(crypto)) >> 33);
-        temp *= 3;
+const ItemData& Randomizer::item_data(unsigned int id) const
+{
+    static const ItemData empty;
+    auto item = items_.find(id);
+    return item ? *item : empty;
+}
 
-        buf[index] += uint8_t(crypto);
-        if(crypto - temp == 0)
-            buf[index] = ~buf[index];
-    }
+unsigned int Randomizer::old_cost(unsigned int id) const
+{
+    auto it = old_costs_.find(id);
+    return (it != old_costs_.end()) ? it->second : 0;
 }
 
 void Randomizer::error(const std::wstring& msg)
 {
-    gui_->error(msg.c_str());
+    last_error_ = msg;
+
+    if(gui_ != nullptr)
+        gui_->error(msg.c_str());
 }
 
 unsigned int Randomizer::level_from_exp(const PuppetData& data, unsigned int exp) const
@@ -1855,13 +2369,8 @@ unsigned int Randomizer::level_from_exp(const PuppetData& data, unsigned int exp
 
 unsigned int Randomizer::level_from_exp(unsigned int cost, unsigned int exp) const
 {
-    int ret = 1;
-    while(exp_for_level(cost, ret + 1) <= exp)
-        ++ret;
-
-    if(ret > 100)
-        ret = 100;
-    return ret;
+    assert(cost < 5);
+    return exp_table_level(exp_table(is_ynk_, cost), exp);
 }
 
 unsigned int Randomizer::exp_for_level(const PuppetData& data, unsigned int level) const
@@ -1871,12 +2380,6 @@ unsigned int Randomizer::exp_for_level(const PuppetData& data, unsigned int leve
 
 unsigned int Randomizer::exp_for_level(unsigned int cost, unsigned int level) const
 {
-    if(level <= 1)
-        return 0;
-
-    const int *mods = (is_ynk_) ? g_cost_exp_modifiers_ynk : g_cost_exp_modifiers;
-
-    unsigned int ret = level * level * level * (unsigned int)mods[cost] / 100u;
-
-    return ret;
+    assert(cost < 5);
+    return exp_table_exp(is_ynk_, cost, level);
 }
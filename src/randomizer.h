@@ -29,36 +29,141 @@
 
 #include "gamedata.h"
 #include "archive.h"
+#include "patch.h"
 #include "containers.h"
+#include "puppet.h"
+#include "random.h"
+#include "statquota.h"
 #include "gui.h"
+#include "intern.h"
 #include <string>
 #include <map>
-#include <set>
 #include <vector>
-#include <random>
 #include <optional>
+#include <functional>
 
-typedef std::set<uint16_t> IDSet;
 typedef std::vector<uint16_t> IDVec;
 typedef RandPool<uint16_t> IDPool;
 typedef RandDeck<uint16_t> IDDeck;
-typedef std::map<unsigned int, std::set<std::wstring>> LocationMap;
+typedef BucketDeck<uint16_t> SkillDeck;
+typedef std::map<unsigned int, std::vector<Symbol>> LocationMap;   /* catch location labels of each puppet, sorted by symbol */
+
+/* randomization is split into stages, run in this order.
+ * each stage's output is cached under a key derived from everything it reads
+ * (options, seed, input files and the keys of the stages it depends on),
+ * so re-running with a few options changed only redoes the affected stages.
+ * the cache is only kept by instances that run more than once, see Randomizer::set_stage_cache() */
+enum RandomizerStage
+{
+    STAGE_PARSE = 0,    /* parse puppets, items, skill and ability names. also randomizes skill cards */
+    STAGE_SKILLS,
+    STAGE_PUPPETS,
+    STAGE_COMPAT,
+    STAGE_NAMES,        /* parse puppet names */
+    STAGE_TRAINERS,
+    STAGE_MAP_EVENTS,
+    STAGE_WILD,
+    STAGE_MAX
+};
+
+/* raw archive file already loaded into memory */
+struct ArchiveBuffer
+{
+    const void *data;
+    std::size_t size;
+};
+
+/* keyed by archive file name, e.g. gn_dat1.arc */
+typedef std::map<std::wstring, ArchiveBuffer> ArchiveBuffers;
+
+/* results of a dry run */
+struct RandomizerOutput
+{
+    std::map<std::wstring, Archive> archives;   /* modified archives keyed by file name, unless writing a patch */
+    Patch patch;                                /* only used when writing a patch */
+};
+
+/* everything the user can choose about a run. the defaults match a fresh GUI, where nothing is randomized.
+ * the 3-state options follow the GUI checkboxes: 0 = off, 1 = checked, 2 = the "middle" state */
+struct RandomizerOptions
+{
+    bool rand_skillsets = false;
+    bool rand_stats = false;
+    bool rand_trainers = false;
+    bool rand_types = false;
+    bool rand_compat = false;
+    bool rand_abilities = false;
+    bool rand_skill_element = false;
+    bool rand_skill_power = false;
+    bool rand_skill_acc = false;
+    bool rand_skill_sp = false;
+    bool rand_skill_prio = false;
+    bool rand_skill_type = false;
+    bool rand_full_party = false;
+    bool rand_export_locations = false;
+    bool rand_quota = false;
+    bool rand_healthy = false;
+    bool rand_true_rand_stats = false;
+    bool rand_prefer_same_type = false;
+    bool rand_export_puppets = false;
+    bool rand_true_rand_skills = false;
+    bool rand_stat_scaling = false;
+    bool rand_strict_trainers = false;
+    bool rand_trainer_sc_shuffle = true;        /* shuffle trainer skill cards instead of using trainer_sc_chance */
+    bool rand_export_compat = false;
+    bool rand_evolved_trainers = false;
+    bool rand_trainer_ai = false;
+    bool rand_trainer_max_ivs = false;
+    bool rand_trainer_max_evs = false;
+    bool rand_blind_trainers = false;
+    bool rand_bike_everywhere = false;
+    bool rand_gap_map_everywhere = false;
+    unsigned int level_mod = 100;               /* trainer and wild puppet levels, in percent */
+    unsigned int stat_quota = 500;
+    unsigned int trainer_sc_chance = 0;         /* percent, values over 100 are clamped */
+    unsigned int trainer_item_chance = 25;      /* percent, values over 100 are clamped */
+    unsigned int stat_ratio = 25;               /* max change in percent with rand_stat_scaling */
+    unsigned int rand_cost = 0;                 /* 3-state, middle sets every puppet to 120 cost */
+    unsigned int rand_encounters = 0;           /* 3-state, middle keeps the encounter rates and number of puppets */
+    unsigned int rand_starting_move = 0;        /* 3-state, checked = same type damaging move, middle = any type */
+    unsigned int rand_skillcards = 0;           /* 3-state, middle leaves sign skills alone */
+    unsigned int rand_costumes = 0;             /* 3-state, middle excludes wedding dresses */
+    QuotaShape quota_shape = QUOTA_BALANCED;
+    bool write_patch = false;   /* write randomizer.patch instead of modifying the game files ("Save as Patch" in the GUI) */
+};
 
 class Randomizer
 {
 private:
+    struct StageOutput
+    {
+        uint64_t key = 0;
+        bool valid = false;
+        std::vector<ArcFile> journal;   /* files the stage repacked, in order */
+        std::function<void()> restore;  /* puts the stage's members back */
+    };
+
+    const ArchiveBuffers *buffers_ = nullptr;  /* if set, archives are read from here instead of the game folder */
+    RandomizerOutput *output_ = nullptr;        /* if set, this is a dry run and nothing is written to disk */
+    std::wstring last_error_;
+
+    StageOutput stage_cache_[STAGE_MAX];
+    uint64_t stage_keys_[STAGE_MAX] = {};
+    bool cache_stages_ = false;
+    unsigned int seed_ = 0;
+
     LocationMap loc_map_;
     RandomizerGUI *gui_;
 
-    std::map<int, PuppetData> puppets_;
-    std::map<int, SkillData> skills_;
-    std::map<unsigned int, ItemData> items_;
+    IDTable<PuppetData> puppets_;
+    IDTable<SkillData> skills_;
+    IDTable<ItemData> items_;
     IDVec valid_puppet_ids_;
     //std::vector<int> puppet_id_pool_;
     IDPool puppet_id_pool_;
-    std::vector<std::wstring> puppet_names_;
-    std::map<int, std::wstring> skill_names_;
-    std::map<int, std::wstring> ability_names_;
+    std::vector<Symbol> puppet_names_;
+    std::map<int, Symbol> skill_names_;
+    std::map<int, Symbol> ability_names_;
     IDSet valid_skills_;
     IDSet valid_abilities_;
     IDSet skillcard_ids_;
@@ -66,97 +171,66 @@ private:
     std::vector<uint8_t> normal_stats_;
     std::vector<uint8_t> evolved_stats_;
     std::map<unsigned int, unsigned int> old_costs_;
-    std::multiset<std::wstring> location_names_;
+    std::vector<unsigned int> location_counts_;     /* times each location name was seen, indexed by symbol */
+    StringPool strings_;                            /* names and location labels, kept across runs (see clear()) */
 
-    std::default_random_engine gen_;
+    RandomEngine gen_;
 
     bool is_ynk_;
-    bool rand_puppets_;
-    bool rand_skillsets_;
-    bool rand_stats_;
-    bool rand_trainers_;
-    bool rand_types_;
-    bool rand_compat_;
-    bool rand_abilities_;
+    bool rand_puppets_;     /* derived from the options at the start of a run */
     bool rand_skills_;
-    bool rand_skill_element_;
-    bool rand_skill_power_;
-    bool rand_skill_acc_;
-    bool rand_skill_sp_;
-    bool rand_skill_prio_;
-    bool rand_skill_type_;
-    bool rand_full_party_;
-    bool rand_export_locations_;
-    bool rand_quota_;
-    bool rand_healthy_;
-    bool rand_true_rand_stats_;
-    bool rand_prefer_same_type_;
-    bool rand_export_puppets_;
-    bool rand_true_rand_skills_;
-    bool rand_stat_scaling_;
-    bool rand_strict_trainers_;
-    bool rand_trainer_sc_shuffle_;
-    bool rand_export_compat_;
-    bool rand_evolved_trainers_;
-    bool rand_trainer_ai_;
-    bool rand_trainer_max_ivs_;
-    bool rand_trainer_max_evs_;
-    bool rand_blind_trainers_;
-    bool rand_bike_everywhere_;
-    bool rand_gap_map_everywhere_;
-    //unsigned int rand_encounter_rates_;
-    unsigned int level_mod_;
-    unsigned int stat_quota_;
-    unsigned int trainer_sc_chance_;
-    unsigned int trainer_item_chance_;
-    unsigned int stat_ratio_;
-    unsigned int rand_cost_;
-    unsigned int rand_encounters_;
-    unsigned int rand_starting_move_;
-    unsigned int rand_skillcards_;
-    unsigned int rand_costumes_;
+
+    RandomizerOptions opts_;
 
     bool parse_puppets(Archive& archive);
     bool parse_items(Archive& archive);
     bool parse_skill_names(Archive& archive);
     bool parse_ability_names(Archive& archive);
+    /* skill pools shared by all puppets during randomize_puppets() */
+    struct SkillPools
+    {
+        IDSet base, normal, evolved, lv70, lv100;
+        SkillCompat cards;                          /* every implemented skill card */
+        SkillCompat card_elements[ELEMENT_MAX];     /* cards by the element of the skill they teach */
+    };
+
     bool randomize_puppets(Archive& archive);
-    void randomize_dod_file(void *src, const void *rand_data);
+    void randomize_puppet(PuppetData& puppet, const SkillPools& pools, RandomEngine& gen, std::size_t normal_pos, std::size_t evolved_pos) const;
+    void randomize_dod_file(void *src, const PuppetCipher& cipher, RandomEngine& gen) const;
     bool randomize_trainers(Archive& archive, ArcFile& rand_data);
     bool randomize_skills(Archive& archive);
     void randomize_mad_file(void *data);
+    void add_catch_location(unsigned int puppet_id, std::string_view label);
     bool randomize_compatibility(Archive& archive);
     bool randomize_wild_puppets(Archive& archive);
     bool parse_puppet_names(Archive& archive);
     bool parse_map_events(Archive& archive);
     bool blind_trainers_in_obs_file(void *data);
 
-    void decrypt_puppet(void *src, const void *rand_data, std::size_t len);
-    void encrypt_puppet(void *src, const void *rand_data, std::size_t len);
+    /* lookups that return a default-constructed entry if the ID is missing */
+    const PuppetData& puppet_data(unsigned int id) const;
+    const SkillData& skill_data(unsigned int id) const;
+    const ItemData& item_data(unsigned int id) const;
+    unsigned int old_cost(unsigned int id) const;
 
     unsigned int level_from_exp(const PuppetData& data, unsigned int exp) const;
     unsigned int level_from_exp(unsigned int cost, unsigned int exp) const;
     unsigned int exp_for_level(const PuppetData& data, unsigned int level) const;
     unsigned int exp_for_level(unsigned int cost, unsigned int level) const;
 
-    /* search for a skill matching one of the given elements and remove it from the deck.
+    /* shuffle the given skills into the deck, indexed by element for get_stab_skill() */
+    template<typename Src, typename Rng>
+    void assign_skill_deck(SkillDeck& deck, const Src& src, Rng& gen) const
+    {
+        deck.assign(src, gen, [this](uint16_t id) { return (std::size_t)skill_data(id).element; });
+    }
+
+    /* draw a skill matching one of the given elements from the deck.
      * if a match is found, returns an optional with the skill ID.
      * if no match is found, returns empty optional */
-    template <typename T>
-    std::optional<uint16_t> get_stab_skill(T& src, int element1, int element2)
+    std::optional<uint16_t> get_stab_skill(SkillDeck& src, int element1, int element2) const
     {
-        for(auto it = src.begin(); it != src.end(); ++it)
-        {
-            auto e = skills_[*it].element;
-            if((e == element1) || (e == element2))
-            {
-                auto ret = *it;
-                src.erase(it);
-                return (uint16_t)ret;
-            }
-        }
-
-        return {};
+        return src.draw_key((unsigned int)element1, (unsigned int)element2);
     }
 
     void error(const std::wstring& msg);
@@ -167,18 +241,52 @@ private:
 
     void clear();
 
+    bool caching() const { return cache_stages_; }
+    uint64_t stage_key(RandomizerStage stage, uint64_t input_hash) const;
+    std::function<void()> save_stage_outputs(RandomizerStage stage);
+    bool run_stage(RandomizerStage stage, Archive& archive, uint64_t input_hash, const std::function<bool()>& func);
+    void add_patch_files(PatchTarget& target, const Archive& archive, RandomizerStage first, RandomizerStage last) const;
+
     bool open_archive(Archive& arc, const std::wstring& path);
-    bool save_archive(Archive& arc, const std::wstring& path);
+    std::future<Archive> open_archive_async(const std::wstring& dir, const std::wstring& name) const;
+    bool open_archive(Archive& arc, std::future<Archive>& pending, const std::wstring& path); /* waits for an archive opened with Archive::open_async() */
+    bool commit_archives(ArchiveWriter& writer);
 
     void set_progress_bar(int percent);
     void increment_progress_bar(); /* increase progress bar by 1% */
 
 public:
-    Randomizer(RandomizerGUI *gui) : gui_(gui) {};
+    Randomizer(RandomizerGUI *gui, const RandomizerOptions& opts = RandomizerOptions()) : gui_(gui), opts_(opts) {}; /* gui may be NULL */
+
+    const RandomizerOptions& options() const { return opts_; }
+    void set_options(const RandomizerOptions& opts) { opts_ = opts; }
+
+    /* keep the output of every stage so that later runs on this instance only redo what changed.
+     * costs a hash of the game data and a copy of each stage's output per run, so it's off by default
+     * for all runs, dry runs included. only worth it when the same seed is run again with a few options
+     * changed, the seed is part of every stage key */
+    void set_stage_cache(bool enable)
+    {
+        cache_stages_ = enable;
+        if(!enable)
+            for(auto& i : stage_cache_)
+                i = StageOutput();
+    }
 
     bool randomize(const std::wstring& dir, unsigned int seed);
 
-    friend RandomizerGUI;
+    /* dry runs, nothing is written to disk (including the exported text files).
+     * the modified archives or the patch are returned in 'out' instead.
+     * the second version reads the archives from memory instead of the game folder */
+    bool randomize(const std::wstring& dir, unsigned int seed, RandomizerOutput& out);
+    bool randomize(const ArchiveBuffers& files, unsigned int seed, RandomizerOutput& out);
+
+    /* message of the last error, for use without a GUI */
+    const std::wstring& last_error() const { return last_error_; }
+
+    /* apply a patch written by randomize() to the game files */
+    bool apply_patch(const std::wstring& dir, const std::wstring& filepath);
+
 };
 
 #endif // RANDOMIZER_H
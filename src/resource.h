@@ -66,6 +66,9 @@
 #define IDC_GAP_MAP_EVERYWHERE          1062
 #define IDC_CHECK1                      1063
 #define IDC_COSTUMES                    1063
+#define IDC_BALANCED_QUOTA              1064
+#define IDC_WRITE_PATCH                 1065
+#define IDC_APPLY_PATCH                 1066
 
 // Next default values for new objects
 // 
@@ -73,7 +76,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        106
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1064
+#define _APS_NEXT_CONTROL_VALUE         1067
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
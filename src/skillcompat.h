@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SKILLCOMPAT_H
+#define SKILLCOMPAT_H
+#include "bitops.h"
+#include "endian.h"
+#include "random.h"
+#include <cstddef>
+#include <cstdint>
+
+#define SKILL_COMPAT_BITS 128
+#define SKILLCARD_FIRST_ITEM 385    /* item id of skill card #1, bit i stands for item SKILLCARD_FIRST_ITEM + i */
+
+/* the 128 skill cards a puppet style is able to learn.
+ * stored in the game data as 16 bytes, bit j of byte i is card (i * 8) + j.
+ * read little endian that's just two 64 bit words, so everything here works a word at a time */
+class SkillCompat
+{
+private:
+    uint64_t words_[2];
+
+public:
+    static constexpr std::size_t encoded_size = 16;
+
+    SkillCompat() : words_{0, 0} {}
+    SkillCompat(uint64_t low, uint64_t high) : words_{low, high} {}
+
+    /* bits set independently with the probability given by dist */
+    static SkillCompat random(const BernoulliMask& dist, RandomEngine& gen)
+    {
+        uint64_t low = dist(gen);
+        uint64_t high = dist(gen);
+        return SkillCompat(low, high);
+    }
+
+    void load(const uint8_t *src)
+    {
+        words_[0] = read_le64(src);
+        words_[1] = read_le64(&src[8]);
+    }
+
+    void store(uint8_t *dest) const
+    {
+        write_le64(dest, words_[0]);
+        write_le64(&dest[8], words_[1]);
+    }
+
+    bool test(unsigned int bit) const { return ((words_[bit / 64] >> (bit % 64)) & 1) != 0; }
+    void set(unsigned int bit) { words_[bit / 64] |= (uint64_t)1 << (bit % 64); }
+    void reset(unsigned int bit) { words_[bit / 64] &= ~((uint64_t)1 << (bit % 64)); }
+    void clear() { words_[0] = words_[1] = 0; }
+
+    bool empty() const { return !(words_[0] | words_[1]); }
+    unsigned int count() const { return popcount(words_[0]) + popcount(words_[1]); }
+
+    /* calls func(bit) for every set bit, lowest first */
+    template<typename Func>
+    void for_each(Func&& func) const
+    {
+        for(unsigned int i = 0; i < 2; ++i)
+        {
+            for(uint64_t word = words_[i]; word; word &= word - 1)
+                func((i * 64) + count_trailing_zeros(word));
+        }
+    }
+
+    SkillCompat operator&(const SkillCompat& rhs) const { return SkillCompat(words_[0] & rhs.words_[0], words_[1] & rhs.words_[1]); }
+    SkillCompat operator|(const SkillCompat& rhs) const { return SkillCompat(words_[0] | rhs.words_[0], words_[1] | rhs.words_[1]); }
+    SkillCompat operator~() const { return SkillCompat(~words_[0], ~words_[1]); }
+    SkillCompat& operator&=(const SkillCompat& rhs) { return *this = *this & rhs; }
+    SkillCompat& operator|=(const SkillCompat& rhs) { return *this = *this | rhs; }
+
+    bool operator==(const SkillCompat& rhs) const { return (words_[0] == rhs.words_[0]) && (words_[1] == rhs.words_[1]); }
+    bool operator!=(const SkillCompat& rhs) const { return !(*this == rhs); }
+};
+
+#endif // SKILLCOMPAT_H
@@ -0,0 +1,144 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STATQUOTA_H
+#define STATQUOTA_H
+#include "random.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+
+/* how stat points are spread across the 6 stats when using a stat quota */
+enum QuotaShape
+{
+    QUOTA_FLAT = 0,     /* every split of the quota with no stat over 255 is equally likely, lopsided stats are common */
+    QUOTA_BALANCED      /* splits cluster around an even spread, extreme stats are rare */
+};
+
+/* split 'quota' into 6 parts uniformly at random (stars and bars).
+ * picks 5 distinct cut points out of quota + 5 slots with Floyd's algorithm,
+ * the parts are the gaps between the cuts */
+inline void split_quota_flat(unsigned int quota, unsigned int (&parts)[6], RandomEngine& gen)
+{
+    const unsigned int slots = quota + 5;
+    unsigned int cuts[5];
+    unsigned int num_cuts = 0;
+
+    for(unsigned int j = slots - 5; j < slots; ++j)
+    {
+        unsigned int t = (unsigned int)random_below(gen, j + 1);
+        bool taken = false;
+        for(unsigned int k = 0; k < num_cuts; ++k)
+            taken = taken || (cuts[k] == t);
+        cuts[num_cuts++] = taken ? j : t;
+    }
+
+    std::sort(std::begin(cuts), std::end(cuts));
+
+    parts[0] = cuts[0];
+    for(unsigned int k = 1; k < 5; ++k)
+        parts[k] = cuts[k] - cuts[k - 1] - 1;
+    parts[5] = slots - 1 - cuts[4];
+}
+
+/* split 'quota' into 6 parts of at most 255 each, every such split equally likely.
+ * unbounded splits are drawn until one fits, which keeps the result uniform over the bounded ones.
+ * above 3 * 255 the parts are sampled as 255 - part, whose quota 6 * 255 - quota has exactly as many
+ * splits. that keeps the acceptance rate above 27%, so this takes less than 4 draws on average */
+inline void split_quota_bounded(unsigned int quota, unsigned int (&parts)[6], RandomEngine& gen)
+{
+    assert(quota <= 6u * 0xff);
+
+    bool complement = (quota > 3u * 0xff);
+    unsigned int target = complement ? ((6u * 0xff) - quota) : quota;
+
+    bool fits;
+    do
+    {
+        split_quota_flat(target, parts, gen);
+
+        fits = true;
+        for(auto i : parts)
+            fits = fits && (i <= 0xff);
+    } while(!fits);
+
+    if(complement)
+    {
+        for(auto& i : parts)
+            i = 0xff - i;
+    }
+}
+
+/* distribute 'quota' stat points across the 6 stats with no stat exceeding 255 */
+inline void sample_stat_quota(unsigned int quota, QuotaShape shape, uint8_t (&stats)[6], RandomEngine& gen)
+{
+    unsigned int parts[6];
+
+    quota = std::min(quota, 6u * 0xff);
+
+    if(shape == QUOTA_BALANCED)
+    {
+        /* averaging several flat splits pulls the result towards an even spread */
+        unsigned int split[6];
+        for(auto& i : parts)
+            i = 0;
+
+        for(int n = 0; n < 3; ++n)
+        {
+            split_quota_bounded(quota, split, gen);
+            for(int i = 0; i < 6; ++i)
+                parts[i] += split[i];
+        }
+
+        unsigned int sum = 0;
+        for(auto& i : parts)
+        {
+            i /= 3;
+            sum += i;
+        }
+
+        /* hand out whatever got lost to rounding, one point per stat starting at a random stat.
+         * full stats are skipped, the averages are at most 255 so the rest always has room */
+        unsigned int start = (unsigned int)random_below(gen, 6);
+        for(unsigned int i = 0; sum < quota; ++i)
+        {
+            auto& part = parts[(start + i) % 6];
+            if(part < 0xff)
+            {
+                ++part;
+                ++sum;
+            }
+        }
+    }
+    else
+    {
+        split_quota_bounded(quota, parts, gen);
+    }
+
+    unsigned int sum = 0;
+    for(int i = 0; i < 6; ++i)
+    {
+        assert(parts[i] <= 0xff);
+        stats[i] = (uint8_t)parts[i];
+        sum += parts[i];
+    }
+    assert(sum == quota);
+    (void)sum;
+}
+
+#endif // STATQUOTA_H
@@ -15,105 +15,414 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#define WIN32_LEAN_AND_MEAN
-#define CP_SJIS 932
-#include <Windows.h>
 #include "textconvert.h"
-#include <memory>
+#include "sjis_tables.h"
+#include <cstdint>
 
-std::wstring sjis_to_utf(const std::string& str)
+#if !defined(TEXT_NO_SSE) && !(defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#define TEXT_NO_SSE
+#endif
+
+#ifndef TEXT_NO_SSE
+#include <emmintrin.h>
+#endif
+
+/* what windows substitutes for code page 932.
+ * invalid shift-jis decodes to U+30FB (katakana middle dot), characters that can't be encoded become '?' */
+#define SJIS_DEFAULT_UTF 0x30FB
+#define SJIS_DEFAULT_CHAR '?'
+
+/* replacement for invalid UTF-8 and unpaired surrogates */
+#define UTF_REPLACEMENT 0xFFFD
+
+static inline bool sjis_is_lead(uint8_t c)
 {
-    std::wstring ret;
+    return ((c >= 0x81) && (c <= 0x9F)) || ((c >= 0xE0) && (c <= 0xFC));
+}
+
+static inline bool sjis_is_trail(uint8_t c)
+{
+    return (c >= 0x40) && (c <= 0xFC) && (c != 0x7F);
+}
 
-    if(str.empty())
-        return ret;
+/* copies the run of ascii characters at the start of src to dest, widening each byte.
+ * returns the length of the run */
+template<typename T>
+static std::size_t widen_ascii(const char *src, std::size_t len, T *dest)
+{
+    std::size_t pos = 0;
+
+#ifndef TEXT_NO_SSE
+    if constexpr(sizeof(T) == 1)
+    {
+        for(; (len - pos) >= 16; pos += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)&src[pos]);
+            if(_mm_movemask_epi8(v))
+                break;
+
+            _mm_storeu_si128((__m128i*)&dest[pos], v);
+        }
+    }
+    else if constexpr(sizeof(T) == 2)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for(; (len - pos) >= 16; pos += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)&src[pos]);
+            if(_mm_movemask_epi8(v))
+                break;
+
+            _mm_storeu_si128((__m128i*)&dest[pos], _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128((__m128i*)&dest[pos + 8], _mm_unpackhi_epi8(v, zero));
+        }
+    }
+#endif
+
+    for(; (pos < len) && !(src[pos] & 0x80); ++pos)
+        dest[pos] = (T)src[pos];
+
+    return pos;
+}
 
-    int len = MultiByteToWideChar(CP_SJIS, MB_PRECOMPOSED, str.c_str(), str.size(), NULL, 0);
-    if(!len)
-        return ret;
+/* copies the run of ascii characters at the start of src to dest, narrowing each to a byte.
+ * returns the length of the run */
+template<typename T>
+static std::size_t narrow_ascii(const T *src, std::size_t len, char *dest)
+{
+    std::size_t pos = 0;
+
+#ifndef TEXT_NO_SSE
+    if constexpr(sizeof(T) == 2)
+    {
+        const __m128i high = _mm_set1_epi16((short)0xFF80);
+        const __m128i zero = _mm_setzero_si128();
+        for(; (len - pos) >= 16; pos += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)&src[pos]);
+            __m128i b = _mm_loadu_si128((const __m128i*)&src[pos + 8]);
+            __m128i test = _mm_and_si128(_mm_or_si128(a, b), high);
+            if(_mm_movemask_epi8(_mm_cmpeq_epi16(test, zero)) != 0xFFFF)
+                break;
+
+            _mm_storeu_si128((__m128i*)&dest[pos], _mm_packus_epi16(a, b));
+        }
+    }
+#endif
+
+    for(; (pos < len) && ((uint32_t)src[pos] < 0x80); ++pos)
+        dest[pos] = (char)src[pos];
+
+    return pos;
+}
 
-    std::unique_ptr<wchar_t[]> buf(new wchar_t[len]);
-    if(!MultiByteToWideChar(CP_SJIS, MB_PRECOMPOSED, str.c_str(), str.size(), buf.get(), len))
-        return ret;
+/* decodes the non-ascii character at str[pos].
+ * a lead byte without a valid trail byte is replaced on its own, the next byte is decoded normally */
+static inline uint32_t sjis_decode(const char *str, std::size_t sz, std::size_t& pos)
+{
+    uint8_t c = (uint8_t)str[pos++];
+    if(!sjis_is_lead(c))
+        return sjis_decode_single[c];
 
-    ret.assign(buf.get(), len);
+    if((pos >= sz) || !sjis_is_trail((uint8_t)str[pos]))
+        return SJIS_DEFAULT_UTF;
 
-    return ret;
+    uint8_t trail = (uint8_t)str[pos++];
+    uint16_t val = sjis_decode_double[(c < 0xA0) ? (c - 0x81) : (c - 0xC1)][trail - 0x40];
+    return val ? val : SJIS_DEFAULT_UTF;
+}
+
+/* writes 1 or 2 bytes */
+static inline char *sjis_encode(uint32_t c, char *out)
+{
+    uint16_t val = (c <= 0xFFFF) ? sjis_encode_table[sjis_encode_page[c >> 8]][c & 0xFF] : 0;
+    if(!val)
+    {
+        *out++ = SJIS_DEFAULT_CHAR;
+    }
+    else if(val < 0x100)
+    {
+        *out++ = (char)val;
+    }
+    else
+    {
+        *out++ = (char)(val >> 8);
+        *out++ = (char)(val & 0xFF);
+    }
+
+    return out;
+}
+
+/* number of continuation bytes following a UTF-8 lead byte, -1 if it can't start a sequence */
+static inline int utf8_extra_bytes(uint8_t c)
+{
+    if(c < 0xC2)
+        return -1;
+    if(c < 0xE0)
+        return 1;
+    if(c < 0xF0)
+        return 2;
+    if(c < 0xF5)
+        return 3;
+    return -1;
+}
+
+/* decodes the non-ascii sequence at str[pos]. an invalid sequence decodes to U+FFFD
+ * and only its valid prefix is consumed */
+static inline uint32_t utf8_decode(const char *str, std::size_t sz, std::size_t& pos)
+{
+    uint8_t c = (uint8_t)str[pos++];
+    int extra = utf8_extra_bytes(c);
+    if(extra < 0)
+        return UTF_REPLACEMENT;
+
+    uint32_t cp = c & (0x3F >> extra);
+    for(int i = 0; i < extra; ++i, ++pos)
+    {
+        if(pos >= sz)
+            return UTF_REPLACEMENT;
+
+        uint8_t next = (uint8_t)str[pos];
+
+        /* reject overlong forms, surrogates and values past U+10FFFF as soon as possible */
+        uint8_t lo = 0x80, hi = 0xBF;
+        if(i == 0)
+        {
+            if(c == 0xE0) lo = 0xA0;
+            else if(c == 0xED) hi = 0x9F;
+            else if(c == 0xF0) lo = 0x90;
+            else if(c == 0xF4) hi = 0x8F;
+        }
+
+        if((next < lo) || (next > hi))
+            return UTF_REPLACEMENT;
+
+        cp = (cp << 6) | (next & 0x3F);
+    }
+
+    return cp;
+}
+
+/* writes 1 to 4 bytes */
+static inline char *utf8_encode(uint32_t cp, char *out)
+{
+    if(cp < 0x80)
+    {
+        *out++ = (char)cp;
+        return out;
+    }
+
+    if(cp < 0x800)
+    {
+        *out++ = (char)(0xC0 | (cp >> 6));
+    }
+    else if(cp < 0x10000)
+    {
+        *out++ = (char)(0xE0 | (cp >> 12));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+    }
+    else
+    {
+        *out++ = (char)(0xF0 | (cp >> 18));
+        *out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+    }
+    *out++ = (char)(0x80 | (cp & 0x3F));
+
+    return out;
+}
+
+/* reads one character from a wide string, combining surrogate pairs.
+ * unpaired surrogates and values past U+10FFFF read as U+FFFD */
+static inline uint32_t wide_decode(const wchar_t *str, std::size_t sz, std::size_t& pos)
+{
+    uint32_t cp = (uint32_t)str[pos++];
+
+    if((cp >= 0xD800) && (cp <= 0xDFFF))
+    {
+        uint32_t next = (pos < sz) ? (uint32_t)str[pos] : 0;
+        if((cp > 0xDBFF) || (next < 0xDC00) || (next > 0xDFFF))
+            return UTF_REPLACEMENT;
+
+        ++pos;
+        return 0x10000 + ((cp - 0xD800) << 10) + (next - 0xDC00);
+    }
+
+    return (cp > 0x10FFFF) ? UTF_REPLACEMENT : cp;
+}
+
+/* wchar_t is UTF-16 on windows and UTF-32 elsewhere */
+static inline wchar_t *wide_encode(uint32_t cp, wchar_t *out)
+{
+    if constexpr(sizeof(wchar_t) == 2)
+    {
+        if(cp > 0xFFFF)
+        {
+            cp -= 0x10000;
+            *out++ = (wchar_t)(0xD800 + (cp >> 10));
+            *out++ = (wchar_t)(0xDC00 + (cp & 0x3FF));
+            return out;
+        }
+    }
+
+    *out++ = (wchar_t)cp;
+    return out;
 }
 
+/* all of the conversions below size the output for the worst case up front,
+ * convert in a single pass straight into it, then trim it to the final length */
+
 std::wstring sjis_to_utf(const char *str, std::size_t sz)
 {
     std::wstring ret;
+    ret.resize(sz); /* at most one character per byte */
 
-    int len = MultiByteToWideChar(CP_SJIS, MB_PRECOMPOSED, str, sz, NULL, 0);
-    if(!len)
-        return ret;
+    wchar_t *out = ret.data();
+    std::size_t pos = 0;
 
-    std::unique_ptr<wchar_t[]> buf(new wchar_t[len]);
-    if(!MultiByteToWideChar(CP_SJIS, MB_PRECOMPOSED, str, sz, buf.get(), len))
-        return ret;
+    while(pos < sz)
+    {
+        std::size_t run = widen_ascii(&str[pos], sz - pos, out);
+        pos += run;
+        out += run;
+        if(pos < sz)
+            *out++ = (wchar_t)sjis_decode(str, sz, pos);
+    }
 
-    ret.assign(buf.get(), len);
+    ret.resize(out - ret.data());
 
     return ret;
 }
 
+std::wstring sjis_to_utf(const std::string& str)
+{
+    return sjis_to_utf(str.data(), str.size());
+}
+
 std::string utf_to_sjis(const std::wstring& str)
 {
     std::string ret;
+    ret.resize(str.size() * 2); /* at most two bytes per character */
 
-    if(str.empty())
-        return ret;
+    const wchar_t *src = str.data();
+    std::size_t sz = str.size();
+    char *out = ret.data();
+    std::size_t pos = 0;
 
-    int len = WideCharToMultiByte(CP_SJIS, 0, str.c_str(), str.size(), NULL, 0, NULL, NULL);
-    if(!len)
-        return ret;
+    while(pos < sz)
+    {
+        std::size_t run = narrow_ascii(&src[pos], sz - pos, out);
+        pos += run;
+        out += run;
+        if(pos < sz)
+            out = sjis_encode(wide_decode(src, sz, pos), out); /* a surrogate pair becomes a single '?' */
+    }
 
-    std::unique_ptr<char[]> buf(new char[len]);
-    if(!WideCharToMultiByte(CP_SJIS, 0, str.c_str(), str.size(), buf.get(), len, NULL, NULL))
-        return ret;
-
-    ret.assign(buf.get(), len);
+    ret.resize(out - ret.data());
 
     return ret;
 }
 
-std::wstring utf_widen(const std::string& str)
+std::string sjis_to_utf8(const char *str, std::size_t sz)
 {
-    std::wstring ret;
+    /* every non-ascii byte adds at most 2 bytes (e.g. halfwidth katakana 0xA1 -> U+FF61) */
+    std::size_t high = 0;
+    for(std::size_t i = 0; i < sz; ++i)
+        high += ((uint8_t)str[i] >> 7);
 
-    if(str.empty())
-        return ret;
+    std::string ret;
+    ret.resize(sz + (high * 2));
 
-    int len = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), str.size(), NULL, 0);
-    if(!len)
-        return ret;
+    char *out = ret.data();
+    std::size_t pos = 0;
 
-    std::unique_ptr<wchar_t[]> buf(new wchar_t[len]);
-    if(!MultiByteToWideChar(CP_UTF8, 0, str.c_str(), str.size(), buf.get(), len))
-        return ret;
+    while(pos < sz)
+    {
+        std::size_t run = widen_ascii(&str[pos], sz - pos, out);
+        pos += run;
+        out += run;
+        if(pos < sz)
+            out = utf8_encode(sjis_decode(str, sz, pos), out);
+    }
 
-    ret.assign(buf.get(), len);
+    ret.resize(out - ret.data());
 
     return ret;
 }
 
-std::string utf_narrow(const std::wstring& str)
+std::string sjis_to_utf8(const std::string& str)
+{
+    return sjis_to_utf8(str.data(), str.size());
+}
+
+std::string utf8_to_sjis(std::string_view str)
 {
     std::string ret;
+    ret.resize(str.size()); /* never longer than the UTF-8 */
+
+    const char *src = str.data();
+    std::size_t sz = str.size();
+    char *out = ret.data();
+    std::size_t pos = 0;
+
+    while(pos < sz)
+    {
+        std::size_t run = widen_ascii(&src[pos], sz - pos, out);
+        pos += run;
+        out += run;
+        if(pos < sz)
+            out = sjis_encode(utf8_decode(src, sz, pos), out);
+    }
+
+    ret.resize(out - ret.data());
+
+    return ret;
+}
+
+std::wstring utf_widen(std::string_view str)
+{
+    std::wstring ret;
+    ret.resize(str.size()); /* a sequence is never shorter than the code units it decodes to */
 
-    if(str.empty())
-        return ret;
+    const char *src = str.data();
+    std::size_t sz = str.size();
+    wchar_t *out = ret.data();
+    std::size_t pos = 0;
 
-    int len = WideCharToMultiByte(CP_UTF8, 0, str.c_str(), str.size(), NULL, 0, NULL, NULL);
-    if(!len)
-        return ret;
+    while(pos < sz)
+    {
+        std::size_t run = widen_ascii(&src[pos], sz - pos, out);
+        pos += run;
+        out += run;
+        if(pos < sz)
+            out = wide_encode(utf8_decode(src, sz, pos), out);
+    }
 
-    std::unique_ptr<char[]> buf(new char[len]);
-    if(!WideCharToMultiByte(CP_UTF8, 0, str.c_str(), str.size(), buf.get(), len, NULL, NULL))
-        return ret;
+    ret.resize(out - ret.data());
+
+    return ret;
+}
 
-    ret.assign(buf.get(), len);
+std::string utf_narrow(const std::wstring& str)
+{
+    std::string ret;
+    ret.resize(str.size() * ((sizeof(wchar_t) == 2) ? 3 : 4));
+
+    const wchar_t *src = str.data();
+    std::size_t sz = str.size();
+    char *out = ret.data();
+    std::size_t pos = 0;
+
+    while(pos < sz)
+    {
+        std::size_t run = narrow_ascii(&src[pos], sz - pos, out);
+        pos += run;
+        out += run;
+        if(pos < sz)
+            out = utf8_encode(wide_decode(src, sz, pos), out);
+    }
+
+    ret.resize(out - ret.data());
 
     return ret;
 }
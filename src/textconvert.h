@@ -18,14 +18,20 @@
 #ifndef TEXTCONVERT_H
 #define TEXTCONVERT_H
 #include <string>
+#include <string_view>
 
 /* conversions between shift-jis and unicode */
 std::wstring sjis_to_utf(const std::string& str);
 std::wstring sjis_to_utf(const char *str, std::size_t sz);
 std::string utf_to_sjis(const std::wstring& str);
 
+/* conversions between shift-jis and UTF-8, which is what the game data is kept as internally */
+std::string sjis_to_utf8(const std::string& str);
+std::string sjis_to_utf8(const char *str, std::size_t sz);
+std::string utf8_to_sjis(std::string_view str);
+
 /* UTF-8 to wchar_t */
-std::wstring utf_widen(const std::string& str);
+std::wstring utf_widen(std::string_view str);
 
 /* wchar_t to UTF-8 */
 std::string utf_narrow(const std::wstring& str);
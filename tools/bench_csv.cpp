@@ -0,0 +1,143 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* times the csv structural scanners in csvscan.h and CSVFile::parse() on a large synthetic csv.
+ * the file mimics the game's tables: a name column with japanese text followed by numeric columns,
+ * shift-jis encoded with \r\n line endings. every scanner is checked against the scalar one first.
+ *
+ * build: g++ -std=c++17 -O2 -I../src bench_csv.cpp ../src/gamedata.cpp ../src/textconvert.cpp -o bench_csv
+ *        cl /std:c++17 /O2 /EHsc /I..\src bench_csv.cpp ..\src\gamedata.cpp ..\src\textconvert.cpp
+ * add -DCSV_NO_SSE (/DCSV_NO_SSE) to time the scalar build of CSVFile::parse() */
+
+#include "csvscan.h"
+#include "gamedata.h"
+#include "random.h"
+#include "textconvert.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define NUM_LINES 200000
+#define NUM_FIELDS 24
+#define ROUNDS 10
+
+/* a few names from the game, so the decoder sees real multibyte text */
+static const char *g_names[] = {"霊夢", "魔理沙", "チルノ", "紅美鈴", "パチュリー・ノーレッジ", "十六夜咲夜", "レミリア・スカーレット", "Test"};
+
+static std::string make_csv(RandomEngine& gen)
+{
+    std::string utf;
+    for(int line = 0; line < NUM_LINES; ++line)
+    {
+        utf += std::to_string(line);
+        utf += ',';
+        utf += g_names[random_below(gen, sizeof(g_names) / sizeof(g_names[0]))];
+        for(int field = 2; field < NUM_FIELDS; ++field)
+        {
+            utf += ',';
+            utf += std::to_string(random_below(gen, (field & 1) ? 256 : 65536));
+        }
+        utf += "\r\n";
+    }
+
+    return utf8_to_sjis(utf);
+}
+
+/* best of ROUNDS, in milliseconds */
+template<typename Func>
+static double time_ms(Func func)
+{
+    double best = 0.0;
+    for(int i = 0; i < ROUNDS; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if((i == 0) || (ms < best))
+            best = ms;
+    }
+
+    return best;
+}
+
+int main()
+{
+    RandomEngine gen(1);
+    std::string sjis = make_csv(gen);
+    std::string utf = sjis_to_utf8(sjis);
+
+    printf("%d lines, %zu bytes shift-jis, %zu bytes UTF-8\n", NUM_LINES, sjis.size(), utf.size());
+
+    struct Scanner
+    {
+        const char *name;
+        CSVScanFunc func;
+    };
+
+    std::vector<Scanner> scanners;
+    scanners.push_back({"scalar", [](const char *str, std::size_t len, std::vector<uint32_t>& out) { csv_scan_scalar(str, 0, len, out); }});
+#ifndef CSV_NO_SSE
+    scanners.push_back({"sse2", csv_scan_sse2});
+    if(cpu_has_avx2())
+        scanners.push_back({"avx2", csv_scan_avx2});
+#endif
+
+    std::vector<uint32_t> expected;
+    scanners[0].func(utf.data(), utf.size(), expected);
+
+    bool ok = true;
+    double scalar_ms = 0.0;
+    for(const auto& scanner : scanners)
+    {
+        std::vector<uint32_t> out;
+        out.reserve(expected.size());
+        scanner.func(utf.data(), utf.size(), out);
+        if(out != expected)
+        {
+            printf("%-8s output differs from the scalar scanner\n", scanner.name);
+            ok = false;
+            continue;
+        }
+
+        double ms = time_ms([&]()
+        {
+            out.clear();
+            scanner.func(utf.data(), utf.size(), out);
+        });
+
+        if(!scalar_ms)
+            scalar_ms = ms;
+
+        printf("scan %-8s %8.2f ms  %6.2f GB/s  (%.1fx)\n", scanner.name, ms, utf.size() / (ms * 1e6), scalar_ms / ms);
+    }
+
+    /* the whole parse: decoding, scanning with the scanner csv_scan() picks and building the spans */
+    CSVFile csv;
+    if(!csv.parse(sjis.data(), sjis.size()) || (csv.num_lines() != NUM_LINES))
+    {
+        printf("CSVFile::parse() failed\n");
+        return 1;
+    }
+
+    double parse_ms = time_ms([&]() { csv.parse(sjis.data(), sjis.size()); });
+    printf("CSVFile::parse %8.2f ms  (%zu lines)\n", parse_ms, csv.num_lines());
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* compares the exp tables in exptable.h against the loop they replaced.
+ * checks that both agree for every cost and exp value a puppet can have, then times them.
+ *
+ * build: g++ -std=c++17 -O2 -I../src bench_exp.cpp -o bench_exp
+ *        cl /std:c++17 /O2 /EHsc /I..\src bench_exp.cpp */
+
+#include "exptable.h"
+#include "random.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+/* the original implementation, recomputing the cubic for every level */
+static unsigned int loop_exp_for_level(bool ynk, unsigned int cost, unsigned int level)
+{
+    if(level <= 1)
+        return 0;
+
+    const unsigned int *mods = ynk ? g_cost_exp_modifiers_ynk : g_cost_exp_modifiers;
+    return level * level * level * mods[cost] / 100u;
+}
+
+static unsigned int loop_level_from_exp(bool ynk, unsigned int cost, unsigned int exp)
+{
+    unsigned int ret = 1;
+    while(loop_exp_for_level(ynk, cost, ret + 1) <= exp)
+        ++ret;
+
+    if(ret > 100)
+        ret = 100;
+    return ret;
+}
+
+struct Query
+{
+    bool ynk;
+    unsigned int cost, exp;
+};
+
+template<typename Func>
+static double time_ns(const std::vector<Query>& queries, int rounds, unsigned long long& checksum, Func func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for(int r = 0; r < rounds; ++r)
+        for(const auto& q : queries)
+            checksum += func(q);
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / ((double)queries.size() * rounds);
+}
+
+int main()
+{
+    /* exhaustive check up to just past the level 100 requirement of the highest modifier */
+    unsigned int mismatches = 0;
+    for(int ynk = 0; ynk < 2; ++ynk)
+    {
+        for(unsigned int cost = 0; cost < 5; ++cost)
+        {
+            unsigned int max_exp = loop_exp_for_level(ynk != 0, cost, 101) + 1000;
+            for(unsigned int exp = 0; exp <= max_exp; ++exp)
+            {
+                if(loop_level_from_exp(ynk != 0, cost, exp) != exp_table_level(exp_table(ynk != 0, cost), exp))
+                    ++mismatches;
+            }
+
+            for(unsigned int level = 0; level <= 200; ++level)
+            {
+                if(loop_exp_for_level(ynk != 0, cost, level) != exp_table_exp(ynk != 0, cost, level))
+                    ++mismatches;
+            }
+        }
+    }
+
+    printf("mismatches: %u\n", mismatches);
+    if(mismatches)
+        return 1;
+
+    /* trainer puppets, so levels are spread over the whole range */
+    RandomEngine gen(1);
+    std::vector<Query> queries(1 << 16);
+    for(auto& q : queries)
+    {
+        q.ynk = (gen() & 1) != 0;
+        q.cost = (unsigned int)random_below(gen, 5);
+        q.exp = loop_exp_for_level(q.ynk, q.cost, 1 + (unsigned int)random_below(gen, 100)) + (unsigned int)random_below(gen, 1000);
+    }
+
+    unsigned long long checksum_loop = 0, checksum_table = 0;
+    double loop = time_ns(queries, 20, checksum_loop, [](const Query& q) { return loop_level_from_exp(q.ynk, q.cost, q.exp); });
+    double table = time_ns(queries, 20, checksum_table, [](const Query& q) { return exp_table_level(exp_table(q.ynk, q.cost), q.exp); });
+
+    printf("level_from_exp  loop: %6.2f ns/call  table: %6.2f ns/call  (%.1fx)\n", loop, table, loop / table);
+    printf("checksums %s\n", (checksum_loop == checksum_table) ? "match" : "DIFFER");
+
+    return (checksum_loop == checksum_table) ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* chi-square checks for the stat quota sampler in statquota.h.
+ *  - flat splits of a small quota must hit every one of the possible splits equally often
+ *  - each stat of a flat split must follow the exact marginal of a uniform split with no stat over 255,
+ *    including quotas where the cap matters
+ *  - for both shapes and with the 255 cap in play, all 6 stats must have the same distribution
+ *    (catches bias from the rounding and excess redistribution passes)
+ * every sample is also checked to sum to the quota. the sampler asserts that no stat goes over 255,
+ * so leave NDEBUG undefined.
+ * a check fails if its statistic is more than 4 standard deviations out (p < 0.00004).
+ *
+ * build: g++ -std=c++17 -O2 -I../src check_quota.cpp -o check_quota
+ *        cl /std:c++17 /O2 /EHsc /I..\src check_quota.cpp */
+
+#include "statquota.h"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#define MAX_Z 4.0
+
+static bool g_failed = false;
+
+/* Wilson-Hilferty normal approximation of a chi-square statistic with df degrees of freedom */
+static double chi2_z(double chi2, double df)
+{
+    double v = 2.0 / (9.0 * df);
+    return (std::cbrt(chi2 / df) - (1.0 - v)) / std::sqrt(v);
+}
+
+static void report(const char *name, double chi2, double df)
+{
+    double z = chi2_z(chi2, df);
+    bool ok = (z < MAX_Z);
+    printf("%-44s chi2 %10.1f  df %6.0f  z %6.2f  %s\n", name, chi2, df, z, ok ? "ok" : "FAIL");
+    g_failed = g_failed || !ok;
+}
+
+static void sample(unsigned int quota, QuotaShape shape, uint8_t (&stats)[6], RandomEngine& gen)
+{
+    sample_stat_quota(quota, shape, stats, gen);
+
+    unsigned int sum = 0;
+    for(auto i : stats)
+        sum += i;
+
+    if(sum != quota)
+    {
+        printf("quota %u: stats sum to %u\n", quota, sum);
+        g_failed = true;
+    }
+}
+
+static double choose(unsigned int n, unsigned int k)
+{
+    double ret = 1.0;
+    for(unsigned int i = 1; i <= k; ++i)
+        ret = ret * (n - k + i) / i;
+    return ret;
+}
+
+/* every split of the quota into 6 parts is equally likely */
+static void check_flat_joint(unsigned int quota, RandomEngine& gen)
+{
+    const unsigned int base = quota + 1;
+    const double num_splits = choose(quota + 5, 5);
+    const unsigned int n = (unsigned int)num_splits * 100;
+
+    std::vector<unsigned int> counts((std::size_t)std::pow(base, 6));
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        uint8_t stats[6];
+        sample(quota, QUOTA_FLAT, stats, gen);
+
+        std::size_t index = 0;
+        for(auto s : stats)
+            index = (index * base) + s;
+        ++counts[index];
+    }
+
+    /* splits that were never drawn still count, so walk every index that sums to the quota */
+    double expected = n / num_splits, chi2 = 0.0;
+    for(std::size_t index = 0; index < counts.size(); ++index)
+    {
+        unsigned int sum = 0;
+        for(std::size_t i = index; i; i /= base)
+            sum += (unsigned int)(i % base);
+
+        if(sum == quota)
+            chi2 += (counts[index] - expected) * (counts[index] - expected) / expected;
+        else if(counts[index])
+            g_failed = true;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "flat, quota %u, all splits uniform", quota);
+    report(name, chi2, num_splits - 1.0);
+}
+
+/* number of ways to split s into 'parts' parts of at most 255 each, for every s up to 6 * 255.
+ * doubles are exact here, the largest count is below 2^53 */
+static std::vector<double> bounded_splits(unsigned int parts)
+{
+    std::vector<double> ways(6 * 0xff + 1);
+    ways[0] = 1.0;
+    for(unsigned int p = 0; p < parts; ++p)
+    {
+        /* each part adds 0 to 255, so the new count is a sliding window sum over the old one */
+        std::vector<double> next(ways.size());
+        double window = 0.0;
+        for(std::size_t t = 0; t < ways.size(); ++t)
+        {
+            window += ways[t];
+            if(t > 0xff)
+                window -= ways[t - 0x100];
+            next[t] = window;
+        }
+        ways = next;
+    }
+    return ways;
+}
+
+/* a single stat of a flat split takes the value k in as many splits as the other 5 stats can
+ * split quota - k between them, out of all bounded splits of the quota into 6 */
+static void check_flat_marginal(unsigned int quota, RandomEngine& gen)
+{
+    const unsigned int n = 200000;
+    std::vector<unsigned int> counts[6];
+    for(auto& i : counts)
+        i.resize(0x100);
+
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        uint8_t stats[6];
+        sample(quota, QUOTA_FLAT, stats, gen);
+        for(int j = 0; j < 6; ++j)
+            ++counts[j][stats[j]];
+    }
+
+    const std::vector<double> ways5 = bounded_splits(5), ways6 = bounded_splits(6);
+    for(int j = 0; j < 6; ++j)
+    {
+        /* neighbouring values are merged until each bin expects at least 5 hits,
+         * a short bin left at the end joins the previous one */
+        double chi2 = 0.0, expected = 0.0, observed = 0.0, last_expected = 0.0, last_observed = 0.0;
+        unsigned int bins = 0;
+        for(unsigned int k = 0; k <= std::min(quota, 0xffu); ++k)
+        {
+            expected += n * ways5[quota - k] / ways6[quota];
+            observed += counts[j][k];
+            if(expected < 5.0)
+                continue;
+
+            if(bins)
+                chi2 += (last_observed - last_expected) * (last_observed - last_expected) / last_expected;
+            last_expected = expected;
+            last_observed = observed;
+            expected = observed = 0.0;
+            ++bins;
+        }
+        last_expected += expected;
+        last_observed += observed;
+        chi2 += (last_observed - last_expected) * (last_observed - last_expected) / last_expected;
+
+        char name[64];
+        snprintf(name, sizeof(name), "flat, quota %u, stat %d marginal", quota, j);
+        report(name, chi2, bins - 1.0);
+    }
+}
+
+/* 6 x 256 contingency table of stat index against value, all rows should be alike */
+static void check_homogeneous(unsigned int quota, QuotaShape shape, RandomEngine& gen)
+{
+    const unsigned int n = 200000;
+    std::vector<double> counts(6 * 256);
+    double mean = 0.0, var = 0.0;
+
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        uint8_t stats[6];
+        sample(quota, shape, stats, gen);
+        for(int j = 0; j < 6; ++j)
+        {
+            counts[(j * 256) + stats[j]] += 1.0;
+            mean += stats[j];
+            var += (double)stats[j] * stats[j];
+        }
+    }
+
+    /* neighbouring values are merged until each column expects at least 5 hits per stat */
+    std::vector<double> rows[6];
+    double col = 0.0, cells[6] = {};
+    for(unsigned int v = 0; v < 256; ++v)
+    {
+        for(int j = 0; j < 6; ++j)
+        {
+            cells[j] += counts[(j * 256) + v];
+            col += counts[(j * 256) + v];
+        }
+
+        if(col >= 30.0 || v == 255)
+        {
+            if(col == 0.0)
+                break;
+            for(int j = 0; j < 6; ++j)
+            {
+                rows[j].push_back(cells[j]);
+                cells[j] = 0.0;
+            }
+            col = 0.0;
+        }
+    }
+
+    /* each row has exactly n samples, so the expected count of a cell is its column total / 6 */
+    double chi2 = 0.0;
+    std::size_t bins = rows[0].size();
+    for(std::size_t c = 0; c < bins; ++c)
+    {
+        double expected = 0.0;
+        for(int j = 0; j < 6; ++j)
+            expected += rows[j][c];
+        expected /= 6.0;
+
+        for(int j = 0; j < 6; ++j)
+            chi2 += (rows[j][c] - expected) * (rows[j][c] - expected) / expected;
+    }
+
+    mean /= n * 6.0;
+    var = (var / (n * 6.0)) - (mean * mean);
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s, quota %u, stats alike (sd %.1f)", (shape == QUOTA_FLAT) ? "flat" : "balanced", quota, std::sqrt(var));
+    report(name, chi2, 5.0 * (bins - 1.0));
+}
+
+int main()
+{
+    RandomEngine gen(1);
+
+    check_flat_joint(10, gen);
+
+    /* 60 never hits the cap, 500 and 765 reject unbounded splits and 1400 samples the complement */
+    for(unsigned int quota : {60u, 500u, 765u, 1400u})
+        check_flat_marginal(quota, gen);
+
+    /* 1400 puts most splits over the cap */
+    for(unsigned int quota : {10u, 500u, 1400u})
+    {
+        check_homogeneous(quota, QUOTA_FLAT, gen);
+        check_homogeneous(quota, QUOTA_BALANCED, gen);
+    }
+
+    printf("%s\n", g_failed ? "FAILED" : "all checks passed");
+    return g_failed ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* compares the shift-jis conversions in textconvert.cpp against the windows code page 932 converter,
+ * which is what the randomizer used before it had its own tables. windows only.
+ *  - decoding: every pair of bytes, and every byte on its own, through MultiByteToWideChar
+ *  - encoding: every BMP character outside the surrogate range through WideCharToMultiByte
+ * characters windows encodes through a best fit mapping but we encode as '?' are expected
+ * (see sjis_tables.h), they're counted separately and listed with -v. anything else is a failure.
+ *
+ * build: cl /std:c++17 /O2 /EHsc /I..\src check_sjis.cpp ..\src\textconvert.cpp */
+
+#include "textconvert.h"
+#include <Windows.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#define CP_SJIS 932
+
+static std::wstring windows_decode(const char *str, int len)
+{
+    wchar_t buf[8];
+    int ret = MultiByteToWideChar(CP_SJIS, MB_PRECOMPOSED, str, len, buf, 8);
+    return std::wstring(buf, (ret > 0) ? ret : 0);
+}
+
+static std::string windows_encode(wchar_t c)
+{
+    char buf[8];
+    int ret = WideCharToMultiByte(CP_SJIS, 0, &c, 1, buf, sizeof(buf), NULL, NULL);
+    return std::string(buf, (ret > 0) ? ret : 0);
+}
+
+static void print_bytes(const std::string& str)
+{
+    for(auto c : str)
+        printf("%02X", (unsigned char)c);
+}
+
+int main(int argc, char **argv)
+{
+    bool verbose = (argc > 1) && !strcmp(argv[1], "-v");
+    unsigned int decode_failures = 0, encode_failures = 0, best_fit = 0;
+
+    for(unsigned int first = 0; first < 256; ++first)
+    {
+        for(int len = 1; len <= 2; ++len)
+        {
+            for(unsigned int second = 0; second < ((len == 2) ? 256u : 1u); ++second)
+            {
+                char str[2] = {(char)first, (char)second};
+                std::wstring ours = sjis_to_utf(str, len);
+                std::wstring theirs = windows_decode(str, len);
+                if(ours == theirs)
+                    continue;
+
+                if(++decode_failures <= 20)
+                {
+                    printf("decode %02X", first);
+                    if(len == 2)
+                        printf(" %02X", second);
+                    printf(":");
+                    for(auto c : ours)
+                        printf(" U+%04X", (unsigned int)c);
+                    printf(", windows:");
+                    for(auto c : theirs)
+                        printf(" U+%04X", (unsigned int)c);
+                    printf("\n");
+                }
+            }
+        }
+    }
+
+    for(unsigned int c = 1; c < 0x10000; ++c)
+    {
+        if((c >= 0xD800) && (c <= 0xDFFF))
+            continue;
+
+        std::string ours = utf_to_sjis(std::wstring(1, (wchar_t)c));
+        std::string theirs = windows_encode((wchar_t)c);
+        if(ours == theirs)
+            continue;
+
+        bool is_best_fit = (ours == "?");
+        if(is_best_fit)
+            ++best_fit;
+        else
+            ++encode_failures;
+
+        if((is_best_fit && verbose) || (!is_best_fit && (encode_failures <= 20)))
+        {
+            printf("%s U+%04X: ", is_best_fit ? "best fit" : "encode", c);
+            print_bytes(ours);
+            printf(", windows: ");
+            print_bytes(theirs);
+            printf("\n");
+        }
+    }
+
+    printf("decode: %u mismatches\n", decode_failures);
+    printf("encode: %u mismatches, %u best fit characters become '?'%s\n", encode_failures, best_fit, verbose ? "" : " (-v lists them)");
+
+    return (decode_failures || encode_failures) ? 1 : 0;
+}
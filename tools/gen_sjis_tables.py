@@ -0,0 +1,160 @@
+#    Copyright (C) 2018 php42
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# generates src/sjis_tables.h from python's cp932 codec, which is built from microsoft's
+# CP932.TXT mapping data plus the few one way mappings windows applies when encoding.
+#
+# usage: python3 gen_sjis_tables.py [output]
+# the output defaults to ../src/sjis_tables.h next to this script. the result is deterministic,
+# so regenerating and checking `git diff` confirms the committed tables are up to date.
+# check_sjis.cpp compares the tables against the windows converter itself.
+
+import os
+import sys
+
+LEADS = list(range(0x81, 0xA0)) + list(range(0xE0, 0xFD))
+TRAILS = [t for t in range(0x40, 0xFD) if t != 0x7F]
+
+HEADER = '''/*
+    Copyright (C) 2018 php42
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SJIS_TABLES_H
+#define SJIS_TABLES_H
+#include <cstdint>
+
+/* code page 932 (windows shift-jis) mapping tables, generated by tools/gen_sjis_tables.py.
+ * this includes the NEC and IBM extensions, the user defined area (0xF040-0xF9FC <-> U+E000-U+E757)
+ * and the windows specific single bytes 0x80, 0xA0 and 0xFD-0xFF.
+ *
+ * characters with more than one code encode to the lowest one, except that the NEC selected IBM
+ * extensions (0xED40-0xEEFC) are never used when the IBM extensions have the same character.
+ * six characters outside the code page also encode one way, e.g. U+301C WAVE DASH -> 0x8160.
+ *
+ * the rest of WideCharToMultiByte's best fit mappings (look-alikes for characters outside the code page)
+ * are left out on purpose, those characters become '?'. the randomizer only encodes ascii and text it
+ * decoded from the game files, which is always in the code page, so this only matters for hand edited
+ * data. there, a visible '?' beats silently swapping in a look-alike. tools/check_sjis.cpp lists them.
+ *
+ * included only by textconvert.cpp */
+
+/* unicode value of each single byte. 0 for lead bytes */
+static const uint16_t sjis_decode_single[256] =
+{
+'''
+
+
+def rows(vals, indent='    '):
+    return ',\n'.join(indent + ', '.join('0x%04X' % v for v in vals[i:i + 16]) for i in range(0, len(vals), 16))
+
+
+def build_tables():
+    decode = {}
+    for lead in LEADS:
+        for trail in TRAILS:
+            try:
+                decode[(lead << 8) | trail] = ord(bytes([lead, trail]).decode('cp932'))
+            except UnicodeDecodeError:
+                pass
+
+    single = [0] * 256
+    for b in range(256):
+        if b not in LEADS:
+            single[b] = ord(bytes([b]).decode('cp932'))
+
+    # lowest code wins, except the NEC selected IBM extensions lose to any other code
+    encode = {}
+    for b in range(0x80, 256):
+        if b not in LEADS:
+            encode.setdefault(single[b], b)
+    for code in sorted(decode, key=lambda c: (0xED40 <= c <= 0xEEFC, c)):
+        encode.setdefault(decode[code], code)
+
+    # one way mappings the encoder also accepts
+    for u in range(0x80, 0x10000):
+        if (u in encode) or (0xD800 <= u <= 0xDFFF):
+            continue
+        try:
+            e = chr(u).encode('cp932')
+        except UnicodeEncodeError:
+            continue
+        encode[u] = e[0] if len(e) == 1 else (e[0] << 8) | e[1]
+
+    return single, decode, encode
+
+
+def generate():
+    single, decode, encode = build_tables()
+    out = [HEADER, rows(single), '\n};\n\n']
+
+    out.append('''/* double byte characters, indexed by [lead byte index][trail byte - 0x40].
+ * lead bytes 0x81-0x9F are 0-30, 0xE0-0xFC are 31-59. 0 means the pair isn't defined */
+static const uint16_t sjis_decode_double[60][189] =
+{
+''')
+    blocks = []
+    for lead in LEADS:
+        vals = [decode.get((lead << 8) | t, 0) for t in range(0x40, 0xFD)]
+        blocks.append('    { /* 0x%02X */\n' % lead + rows(vals, '        ') + '\n    }')
+    out.append(',\n'.join(blocks) + '\n};\n\n')
+
+    pages = sorted(set(u >> 8 for u in encode))
+    page_index = [0] * 256
+    for i, p in enumerate(pages):
+        page_index[p] = i + 1
+
+    out.append('''/* unicode to shift-jis in 256 character pages. sjis_encode_page maps the high byte of a
+ * character to its page in sjis_encode_table, page 0 is empty.
+ * values below 0x100 are single bytes, 0 means the character can't be encoded */
+static const uint8_t sjis_encode_page[256] =
+{
+''')
+    out.append(',\n'.join('    ' + ', '.join('%3d' % v for v in page_index[i:i + 16]) for i in range(0, 256, 16)) + '\n};\n\n')
+
+    out.append('static const uint16_t sjis_encode_table[%d][256] =\n{\n' % (len(pages) + 1))
+    blocks = ['    { 0 /* empty */ }']
+    for p in pages:
+        vals = [encode.get((p << 8) | c, 0) for c in range(256)]
+        blocks.append('    { /* U+%02X00 */\n' % p + rows(vals, '        ') + '\n    }')
+    out.append(',\n'.join(blocks) + '\n};\n\n#endif // SJIS_TABLES_H\n')
+
+    return ''.join(out)
+
+
+def main():
+    if len(sys.argv) > 1:
+        path = sys.argv[1]
+    else:
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src', 'sjis_tables.h')
+
+    with open(path, 'w', newline='\n') as f:
+        f.write(generate())
+
+
+if __name__ == '__main__':
+    main()